@@ -26,8 +26,12 @@
 #ifndef ARRAY_WRITER_H
 #define ARRAY_WRITER_H
 
+#include <cmath>
+#include <deque>
+
 #include <array/ArrayIterator.h>
 #include <array/MemArray.h>
+#include <array/SinglePassArray.h>
 #include <network/Network.h>
 #include <query/Query.h>
 #include <query/Expression.h>
@@ -101,6 +105,35 @@ public:
         return &(_data[0]);
     }
 
+    /**
+     * Halve the vector by OR-ing the upper half into the lower half: bit i % (size/2) is set in the result iff bit i
+     * or bit i + size/2 was set.
+     */
+    void fold()
+    {
+        if(_size % 16 != 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "folding an odd bit vector";
+        }
+        size_t const half = _data.size() / 2;
+        for(size_t i =0; i<half; ++i)
+        {
+            _data[i] = static_cast<char>(_data[i] | _data[i + half]);
+        }
+        _data.resize(half);
+        _size = _size / 2;
+    }
+
+    size_t countSet() const
+    {
+        size_t count = 0;
+        for(size_t i =0; i<_data.size(); ++i)
+        {
+            count += __builtin_popcount(static_cast<unsigned char>(_data[i]));
+        }
+        return count;
+    }
+
     void orIn(BitVector const& other)
     {
         if(other._size != _size)
@@ -140,6 +173,48 @@ public:
         _vec.set(hash2);
     }
 
+    /**
+     * Shrink the filter to no less than targetBitSize bits, if its size allows. Since the bits are picked modulo the
+     * size, a filter of an even size folds into exactly the filter of half that size, with the same contents.
+     * Must be done the same way on all instances, before globalExchange.
+     */
+    void fold(size_t const targetBitSize)
+    {
+        size_t const origSize = _vec.getBitSize();
+        while(_vec.getBitSize() % 16 == 0 && _vec.getBitSize() / 2 >= targetBitSize)
+        {
+            _vec.fold();
+        }
+        if(_vec.getBitSize() != origSize)
+        {
+            LOG4CXX_DEBUG(logger, "EJ bloom filter folded from "<<origSize<<" to "<<_vec.getBitSize()<<" bits");
+        }
+    }
+
+    size_t getBitSize() const
+    {
+        return _vec.getBitSize();
+    }
+
+    size_t getByteSize() const
+    {
+        return _vec.getByteSize();
+    }
+
+    size_t countSetBits() const
+    {
+        return _vec.countSet();
+    }
+
+    /**
+     * A key that was not added passes if both its bits are set: about the square of the share of bits set.
+     */
+    double estimateFalsePositiveRate(size_t const bitsSet) const
+    {
+        double const fill = static_cast<double>(bitsSet) / _vec.getBitSize();
+        return fill * fill;
+    }
+
     bool hasData(void const* data, size_t const dataSize ) const
     {
          uint32_t bitSize = safe_static_cast<uint32_t>(_vec.getBitSize());
@@ -236,6 +311,107 @@ public:
     }
 };
 
+/**
+ * A HyperLogLog sketch of the join key hashes: estimates the number of distinct keys in 4KB, and sketches from
+ * different instances combine by taking the maximum of each register. Also counts the hashes added.
+ */
+class HyperLogLog
+{
+public:
+    static size_t const INDEX_BITS    = 12;
+    static size_t const NUM_REGISTERS = 1 << INDEX_BITS;
+
+private:
+    vector<uint8_t> _registers;
+    size_t          _count;
+
+public:
+    HyperLogLog():
+        _registers(NUM_REGISTERS, 0),
+        _count(0)
+    {}
+
+    /**
+     * @param hash must be a full 32-bit hash of the keys, not reduced modulo anything
+     */
+    void addHash(uint32_t const hash)
+    {
+        ++_count;
+        uint32_t const idx  = hash >> (32 - INDEX_BITS);
+        uint32_t const rest = hash << INDEX_BITS;
+        uint8_t const rank = static_cast<uint8_t>(rest == 0 ? 32 - INDEX_BITS + 1 : __builtin_clz(rest) + 1);
+        if(rank > _registers[idx])
+        {
+            _registers[idx] = rank;
+        }
+    }
+
+    size_t getCount() const
+    {
+        return _count;
+    }
+
+    size_t estimate() const
+    {
+        double const m = NUM_REGISTERS;
+        double sum = 0;
+        size_t zeros = 0;
+        for(size_t i=0; i<NUM_REGISTERS; ++i)
+        {
+            sum += std::ldexp(1.0, -_registers[i]);
+            if(_registers[i] == 0)
+            {
+                ++zeros;
+            }
+        }
+        double res = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+        double const twoTo32 = 4294967296.0;
+        if(res <= 2.5 * m && zeros > 0)
+        {
+            res = m * std::log(m / zeros); //linear counting for the small range
+        }
+        else if(res > twoTo32 / 30)
+        {
+            res = -twoTo32 * std::log(1 - res / twoTo32);
+        }
+        return std::min<size_t>(static_cast<size_t>(res + 0.5), _count);
+    }
+
+    void merge(char const* registers, size_t const count)
+    {
+        for(size_t i=0; i<NUM_REGISTERS; ++i)
+        {
+            _registers[i] = std::max<uint8_t>(_registers[i], static_cast<uint8_t>(registers[i]));
+        }
+        _count += count;
+    }
+
+    void globalExchange(shared_ptr<Query>& query)
+    {
+        size_t const nInstances = query->getInstancesCount();
+        InstanceID myId = query->getInstanceID();
+        shared_ptr<SharedBuffer> buf(new MemoryBuffer(SCIDB_CODE_LOC, NULL, sizeof(size_t) + NUM_REGISTERS));
+        *((size_t*) buf->getWriteData()) = _count;
+        memcpy(((char*) buf->getWriteData()) + sizeof(size_t), &(_registers[0]), NUM_REGISTERS);
+        for(InstanceID i=0; i<nInstances; i++)
+        {
+           if(i != myId)
+           {
+               BufSend(i, buf, query);
+           }
+        }
+        for(InstanceID i=0; i<nInstances; i++)
+        {
+           if(i != myId)
+           {
+               buf = BufReceive(i,query);
+               char const* data = (char const*) buf->getWriteData();
+               merge(data + sizeof(size_t), *((size_t const*) data));
+           }
+        }
+    }
+};
+
 /**
  * First add in tuples from one of the arrays and then filter chunk positions from the other arrays.
  * The WHICH template corresponds to the generator / training array
@@ -304,6 +480,11 @@ public:
         LOG4CXX_DEBUG(logger, message.str());
     }
 
+    size_t getByteSize() const
+    {
+        return _numJoinedDimensions == 0 ? 0 : _chunkHits.getByteSize();
+    }
+
     void addTuple(vector<Value const*> const& tuple)
     {
         if(_numJoinedDimensions==0)
@@ -344,13 +525,248 @@ public:
     }
 };
 
+/**
+ * Decides which instance receives each hash. A reservoir sample of hashes is kept on every instance while an array is
+ * tupled; the coordinator merges the samples, marks the hashes that alone account for a large share of the rows as
+ * heavy and cuts the rest of the hash space into intervals of roughly equal sampled weight.
+ */
+class HashPartitioning
+{
+public:
+    static size_t const SAMPLES_PER_INSTANCE = 4096;
+
+private:
+    size_t const      _numInstances;
+    bool const        _detectHeavy;
+    uint64_t          _numSeen;
+    vector<uint32_t>  _samples;
+    uint64_t          _rngState;
+    vector<uint32_t>  _heavyHashes;   //sorted
+    vector<uint32_t>  _hashBreaks;    //_numInstances-1 of them, see ArrayWriter::getPartition
+
+    uint64_t nextRandom()
+    {
+        _rngState ^= _rngState << 13;
+        _rngState ^= _rngState >> 7;
+        _rngState ^= _rngState << 17;
+        return _rngState;
+    }
+
+    void computePlan(vector<std::pair<uint32_t, double> >& weighted)
+    {
+        std::sort(weighted.begin(), weighted.end());
+        vector<std::pair<uint32_t, double> > distinct;
+        double totalWeight = 0;
+        for(size_t i=0; i<weighted.size(); ++i)
+        {
+            if(distinct.size() && distinct.back().first == weighted[i].first)
+            {
+                distinct.back().second += weighted[i].second;
+            }
+            else
+            {
+                distinct.push_back(weighted[i]);
+            }
+            totalWeight += weighted[i].second;
+        }
+        //a hash is heavy if it alone is worth at least half of one instance's fair share
+        double heavyWeight = 0;
+        _heavyHashes.clear();
+        if(_detectHeavy)
+        {
+            for(size_t i=0; i<distinct.size(); ++i)
+            {
+                if(distinct[i].second * 2 * _numInstances >= totalWeight)
+                {
+                    _heavyHashes.push_back(distinct[i].first);
+                    heavyWeight += distinct[i].second;
+                }
+            }
+        }
+        double const lightWeight = totalWeight - heavyWeight;
+        if(lightWeight <= 0)
+        {
+            return; //keep the even breaks
+        }
+        double cumulative = 0;
+        size_t nextBreak = 0;
+        for(size_t i=0; i<distinct.size() && nextBreak < _hashBreaks.size(); ++i)
+        {
+            if(isHeavy(distinct[i].first))
+            {
+                continue;
+            }
+            cumulative += distinct[i].second;
+            while(nextBreak < _hashBreaks.size() && cumulative >= lightWeight * (nextBreak+1) / _numInstances)
+            {
+                _hashBreaks[nextBreak++] = distinct[i].first;
+            }
+        }
+        for(; nextBreak < _hashBreaks.size(); ++nextBreak)
+        {
+            _hashBreaks[nextBreak] = distinct.back().first;
+        }
+    }
+
+public:
+    HashPartitioning(Settings const& settings, shared_ptr<Query> const& query, bool const detectHeavy):
+        _numInstances(query->getInstancesCount()),
+        _detectHeavy (detectHeavy && _numInstances > 1),
+        _numSeen     (0),
+        _rngState    (0x9E3779B97F4A7C15ULL ^ query->getInstanceID()),
+        _hashBreaks  (_numInstances-1, 0)
+    {
+        _samples.reserve(SAMPLES_PER_INSTANCE);
+        uint32_t breakInterval = safe_static_cast<uint32_t>(settings.getNumHashBuckets() / _numInstances);
+        for(size_t i=0; i<_hashBreaks.size(); ++i)
+        {
+            _hashBreaks[i] = safe_static_cast<uint32_t>(breakInterval * (i+1));
+        }
+    }
+
+    void addHash(uint32_t const hash)
+    {
+        ++_numSeen;
+        if(_samples.size() < SAMPLES_PER_INSTANCE)
+        {
+            _samples.push_back(hash);
+        }
+        else
+        {
+            uint64_t slot = nextRandom() % _numSeen;
+            if(slot < SAMPLES_PER_INSTANCE)
+            {
+                _samples[slot] = hash;
+            }
+        }
+    }
+
+    bool isHeavy(uint32_t const hash) const
+    {
+        return _heavyHashes.size() && std::binary_search(_heavyHashes.begin(), _heavyHashes.end(), hash);
+    }
+
+    vector<uint32_t> const& getHashBreaks() const
+    {
+        return _hashBreaks;
+    }
+
+    /**
+     * Route on the destination instance instead of the hash: value i goes to instance i.
+     */
+    void routeByInstance()
+    {
+        _heavyHashes.clear();
+        for(size_t i=0; i<_hashBreaks.size(); ++i)
+        {
+            _hashBreaks[i] = safe_static_cast<uint32_t>(i);
+        }
+    }
+
+    /**
+     * Two-phase like BloomFilter::globalExchange: samples go to the coordinator, which computes the plan and sends
+     * it back as [numHeavy, heavy hashes..., hash breaks...].
+     */
+    void globalExchange(shared_ptr<Query>& query)
+    {
+        InstanceID myId = query->getInstanceID();
+        if(!query->isCoordinator())
+        {
+            InstanceID coordinator = query->getCoordinatorID();
+            size_t const bufSize = 2*sizeof(uint64_t) + _samples.size() * sizeof(uint32_t);
+            shared_ptr<SharedBuffer> buf(new MemoryBuffer(SCIDB_CODE_LOC, NULL, bufSize));
+            uint64_t* header = (uint64_t*) buf->getWriteData();
+            header[0] = _numSeen;
+            header[1] = _samples.size();
+            if(_samples.size())
+            {
+                memcpy(header+2, &(_samples[0]), _samples.size() * sizeof(uint32_t));
+            }
+            BufSend(coordinator, buf, query);
+            buf = BufReceive(coordinator, query);
+            header = (uint64_t*) buf->getWriteData();
+            uint32_t const* data = (uint32_t const*) (header+1);
+            _heavyHashes.assign(data, data + header[0]);
+            _hashBreaks.assign(data + header[0], data + header[0] + _hashBreaks.size());
+        }
+        else
+        {
+            vector<std::pair<uint32_t, double> > weighted;
+            weighted.reserve(_numInstances * SAMPLES_PER_INSTANCE);
+            for(InstanceID i=0; i<_numInstances; ++i)
+            {
+                uint64_t numSeen = _numSeen;
+                uint64_t numSamples = _samples.size();
+                uint32_t const* samples = numSamples ? &(_samples[0]) : NULL;
+                shared_ptr<SharedBuffer> inBuf;
+                if(i != myId)
+                {
+                    inBuf = BufReceive(i, query);
+                    uint64_t const* header = (uint64_t const*) inBuf->getWriteData();
+                    numSeen = header[0];
+                    numSamples = header[1];
+                    samples = (uint32_t const*) (header+2);
+                }
+                for(uint64_t j=0; j<numSamples; ++j)
+                {
+                    weighted.push_back(std::make_pair(samples[j], ((double) numSeen) / numSamples));
+                }
+            }
+            if(weighted.size())
+            {
+                computePlan(weighted);
+            }
+            size_t const bufSize = sizeof(uint64_t) + (_heavyHashes.size() + _hashBreaks.size()) * sizeof(uint32_t);
+            shared_ptr<SharedBuffer> buf(new MemoryBuffer(SCIDB_CODE_LOC, NULL, bufSize));
+            uint64_t* header = (uint64_t*) buf->getWriteData();
+            header[0] = _heavyHashes.size();
+            uint32_t* data = (uint32_t*) (header+1);
+            std::copy(_heavyHashes.begin(), _heavyHashes.end(), data);
+            std::copy(_hashBreaks.begin(),  _hashBreaks.end(),  data + _heavyHashes.size());
+            for(InstanceID i=0; i<_numInstances; ++i)
+            {
+                if(i != myId)
+                {
+                    BufSend(i, buf, query);
+                }
+            }
+        }
+        ostringstream message;
+        message<<"EJ hash partitioning sampled "<<_samples.size()<<" of "<<_numSeen<<" local rows; heavy hashes "<<_heavyHashes.size()<<"; breaks ";
+        for(size_t i=0; i<_hashBreaks.size(); ++i)
+        {
+            message<<_hashBreaks[i]<<" ";
+        }
+        LOG4CXX_DEBUG(logger, message.str());
+    }
+};
+
+/**
+ * All the intermediate arrays share the [dst_instance_id, src_instance_id, value_no] shape; the last attribute is
+ * what TupledArrayStream routes on (usually the hash).
+ */
+inline ArrayDesc makeStateSchema(std::vector<AttributeDesc> const& attributes, Settings const& settings, shared_ptr< Query> const& query)
+{
+    Attributes outputAttributes;
+    for (size_t i = 0; i< attributes.size(); ++i) {
+        const AttributeDesc pushable(attributes[i]);
+        outputAttributes.push_back(pushable);
+    }
+    outputAttributes.addEmptyTagAttribute();
+    Dimensions outputDimensions;
+    outputDimensions.push_back(DimensionDesc("dst_instance_id", 0, query->getInstancesCount()-1,             1,         0));
+    outputDimensions.push_back(DimensionDesc("src_instance_id", 0, query->getInstancesCount()-1,             1,         0));
+    outputDimensions.push_back(DimensionDesc("value_no",        0, CoordinateBounds::getMax(),               settings.getChunkSize(), 0));
+    return ArrayDesc("equi_join_state" , outputAttributes, outputDimensions, createDistribution(dtUndefined), query->getDefaultArrayResidency());
+}
+
 template <Handedness WHICH>
 ArrayDesc makeTupledSchema(Settings const& settings, shared_ptr< Query> const& query)
 {
     size_t const numAttrs = ( WHICH == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize()) + 1; //plus hash
-    Attributes outputAttributes;
     std::vector<AttributeDesc> tmpOutput(numAttrs);
-    tmpOutput[numAttrs-1] = AttributeDesc("hash", TID_UINT32, 0, CompressorType::NONE);
+    CompressorType const compression = settings.getShuffleCompression();
+    tmpOutput[numAttrs-1] = AttributeDesc("hash", TID_UINT32, 0, compression);
     ArrayDesc const& inputSchema = ( WHICH == LEFT ? settings.getLeftSchema() : settings.getRightSchema());
     size_t const numInputAttrs = (WHICH == LEFT ? settings.getNumLeftAttrs() : settings.getNumRightAttrs());
     size_t const numInputDims = (WHICH == LEFT ? settings.getNumLeftDims() : settings.getNumRightDims());
@@ -364,7 +780,7 @@ ArrayDesc makeTupledSchema(Settings const& settings, shared_ptr< Query> const& q
         {
             flags |= AttributeDesc::IS_NULLABLE;
         }
-        tmpOutput[destinationId] = AttributeDesc(input.getName(), input.getType(), flags, CompressorType::NONE);
+        tmpOutput[destinationId] = AttributeDesc(input.getName(), input.getType(), flags, compression);
         i++;
     }
     for(size_t i = 0; i< numInputDims; ++i )
@@ -375,25 +791,67 @@ ArrayDesc makeTupledSchema(Settings const& settings, shared_ptr< Query> const& q
             continue;
         }
         DimensionDesc const& inputDim = inputSchema.getDimensions()[i];
-        tmpOutput[destinationId] = AttributeDesc(inputDim.getBaseName(), TID_INT64, 0, CompressorType::NONE);
+        tmpOutput[destinationId] = AttributeDesc(inputDim.getBaseName(), TID_INT64, 0, compression);
     }
-    for (size_t i = 0; i< numAttrs; ++i) {
-        const AttributeDesc pushable(tmpOutput[i]);
-        outputAttributes.push_back(pushable);
+    return makeStateSchema(tmpOutput, settings, query);
+}
+
+/**
+ * For late materialization: the join keys of a tupled array, where the tuple is stored (instance and value_no in the
+ * local tupled array) and the hash.
+ */
+template <Handedness WHICH>
+ArrayDesc makeLocatorSchema(Settings const& settings, shared_ptr< Query> const& query)
+{
+    ArrayDesc const tupledSchema = makeTupledSchema<WHICH>(settings, query);
+    CompressorType const compression = settings.getShuffleCompression();
+    std::vector<AttributeDesc> attributes;
+    for(size_t i=0; i<settings.getNumKeys(); ++i)
+    {
+        attributes.push_back(tupledSchema.getAttributes(true).findattr(i));
     }
-    outputAttributes.addEmptyTagAttribute();
-    Dimensions outputDimensions;
-    outputDimensions.push_back(DimensionDesc("dst_instance_id", 0, query->getInstancesCount()-1,             1,         0));
-    outputDimensions.push_back(DimensionDesc("src_instance_id", 0, query->getInstancesCount()-1,             1,         0));
-    outputDimensions.push_back(DimensionDesc("value_no",        0, CoordinateBounds::getMax(),               settings.getChunkSize(), 0));
-    return ArrayDesc("equi_join_state" , outputAttributes, outputDimensions, createDistribution(dtUndefined), query->getDefaultArrayResidency());
+    attributes.push_back(AttributeDesc("src_instance", TID_INT64,  0, compression));
+    attributes.push_back(AttributeDesc("src_pos",      TID_INT64,  0, compression));
+    attributes.push_back(AttributeDesc("hash",         TID_UINT32, 0, compression));
+    return makeStateSchema(attributes, settings, query);
+}
+
+/**
+ * For late materialization: a matched pair sent to the instance that stores the left tuple.
+ */
+inline ArrayDesc makeFetchRequestSchema(Settings const& settings, shared_ptr< Query> const& query)
+{
+    CompressorType const compression = settings.getShuffleCompression();
+    std::vector<AttributeDesc> attributes;
+    attributes.push_back(AttributeDesc("left_pos",       TID_INT64,  0, compression));
+    attributes.push_back(AttributeDesc("right_instance", TID_INT64,  0, compression));
+    attributes.push_back(AttributeDesc("right_pos",      TID_INT64,  0, compression));
+    attributes.push_back(AttributeDesc("dst",            TID_UINT32, 0, compression));
+    return makeStateSchema(attributes, settings, query);
+}
+
+/**
+ * For late materialization: a fetched left tuple sent to the instance that stores its matching right tuple.
+ */
+inline ArrayDesc makeFetchedSchema(Settings const& settings, shared_ptr< Query> const& query)
+{
+    ArrayDesc const tupledSchema = makeTupledSchema<LEFT>(settings, query);
+    CompressorType const compression = settings.getShuffleCompression();
+    std::vector<AttributeDesc> attributes;
+    for(size_t i=0; i<settings.getLeftTupleSize(); ++i)
+    {
+        attributes.push_back(tupledSchema.getAttributes(true).findattr(i));
+    }
+    attributes.push_back(AttributeDesc("right_pos", TID_INT64,  0, compression));
+    attributes.push_back(AttributeDesc("dst",       TID_UINT32, 0, compression));
+    return makeStateSchema(attributes, settings, query);
 }
 
 enum WriteArrayType
 {
-    WRITE_TUPLED,           //we're writing a tupled array (schema as above), we don't really use the dst_instance_id dimension
-    WRITE_SPLIT_ON_HASH,    //we're writing a tupled array (schema as above), we expect input to be sorted on hash and we assign dst_instance_id chunks based on hash
-    WRITE_OUTPUT            //we're writing the output array (schema as generated in Settings). Here we merge left+right tuples and use the Filter Expression if any.
+    WRITE_TUPLED,           //we're writing a tupled array (schema as above), we don't really use the dst_instance_id dimension; see TupledArrayStream for partitioning
+    WRITE_OUTPUT,           //we're writing the output array (schema as generated in Settings). Here we merge left+right tuples and use the Filter Expression if any.
+    WRITE_REPORT            //we're writing the explain:true or profile:true output: [instance_id, value_no] like WRITE_OUTPUT, with no filter
 };
 
 template<WriteArrayType MODE>
@@ -413,14 +871,14 @@ private:
     Coordinates                         _outputPosition;
     vector<shared_ptr<ArrayIterator> >  _arrayIterators;
     vector<shared_ptr<ChunkIterator> >  _chunkIterators;
-    vector <uint32_t>                   _hashBreaks;
-    int64_t                             _currentBreak;
     Value                               _boolTrue;
     Value                               _nullVal;
     shared_ptr<Expression>              _filterExpression;
     vector<BindInfo>                    _filterBindings;
     size_t                              _numBindings;
     shared_ptr<ExpressionContext>       _filterContext;
+    size_t                              _numMatches;     //tuples given to write, before the filter
+    shared_ptr<PhaseTimer>              _probeTimer;     //an output writer lives through the probe, until finalize
 
 public:
     ArrayWriter(Settings const& settings, shared_ptr<Query> const& query, ArrayDesc const& schema):
@@ -435,13 +893,16 @@ public:
         _query            (query),
         _settings         (settings),
         _tuplePlaceholder (_numAttributes,  NULL),
-        _outputPosition   (MODE == WRITE_OUTPUT ? 2 : 3, 0),
+        _outputPosition   (MODE == WRITE_TUPLED ? 3 : 2, 0),
         _arrayIterators   (_numAttributes+1, NULL),
         _chunkIterators   (_numAttributes+1, NULL),
-        _hashBreaks       (_numInstances-1, 0),
-        _currentBreak     (0),
-        _filterExpression (MODE == WRITE_OUTPUT ? settings.getFilterExpression() : NULL)
+        _filterExpression (MODE == WRITE_OUTPUT ? settings.getFilterExpression() : NULL),
+        _numMatches       (0)
     {
+        if(MODE == WRITE_OUTPUT)
+        {
+            _probeTimer.reset(new PhaseTimer(settings.getProfile(), Profile::PROBE));
+        }
         _boolTrue.setBool(true);
         _nullVal.setNull();
         size_t i = 0;
@@ -450,7 +911,7 @@ public:
             _arrayIterators[i] = _output->getIterator(attr);
             i++;
         }
-        if(MODE == WRITE_OUTPUT)
+        if(MODE != WRITE_TUPLED)
         {
             _outputPosition[0] = _myInstanceId;
             _outputPosition[1] = 0;
@@ -478,15 +939,6 @@ public:
             _outputPosition[0] = 0;
             _outputPosition[1] = _myInstanceId;
             _outputPosition[2] = 0;
-            if(MODE == WRITE_SPLIT_ON_HASH)
-            {
-                uint32_t break_interval = safe_static_cast<uint32_t>(
-                    settings.getNumHashBuckets() / _numInstances);
-                for(uint32_t i=0; i<_numInstances-1; ++i)
-                {
-                    _hashBreaks[i] = break_interval * (i+1);
-                }
-            }
         }
     }
 
@@ -514,30 +966,12 @@ public:
 
     void writeTuple(vector<Value const*> const& tuple)
     {
+        ++_numMatches;
         if(MODE == WRITE_OUTPUT && !tuplePassesFilter(tuple))
         {
             return;
         }
-        bool newChunk = false;
-        if(MODE == WRITE_SPLIT_ON_HASH)
-        {
-            uint32_t hash = tuple[ _numAttributes-1 ]->getUint32();
-            while( static_cast<size_t>(_currentBreak) < _numInstances - 1 && hash > _hashBreaks[_currentBreak] )
-            {
-                ++_currentBreak;
-            }
-            if( _currentBreak != _outputPosition[0] )
-            {
-                _outputPosition[0] = _currentBreak;
-                _outputPosition[2] = 0;
-                newChunk =true;
-            }
-        }
-        if (_outputPosition[MODE == WRITE_OUTPUT ? 1 : 2] % _chunkSize == 0)
-        {
-            newChunk = true;
-        }
-        if( newChunk )
+        if (_outputPosition[MODE == WRITE_TUPLED ? 2 : 1] % _chunkSize == 0)
         {
             for(size_t i=0; i<_numAttributes+1; ++i)
             {
@@ -555,21 +989,7 @@ public:
         }
         _chunkIterators[_numAttributes]->setPosition(_outputPosition);
         _chunkIterators[_numAttributes]->writeItem(_boolTrue);
-        ++_outputPosition[ MODE == WRITE_OUTPUT ? 1 : 2];
-    }
-
-    void writeTupleWithHash(vector<Value const*> const& tuple, Value const& hash)
-    {
-        if(MODE != WRITE_TUPLED)
-        {
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal inconsistency";
-        }
-        for(size_t i=0; i<_numAttributes-1; ++i)
-        {
-            _tuplePlaceholder[i] = tuple[i];
-        }
-        _tuplePlaceholder[_numAttributes-1] = &hash;
-        writeTuple(_tuplePlaceholder);
+        ++_outputPosition[ MODE == WRITE_TUPLED ? 2 : 1];
     }
 
     //combine two tuples (i.e. join); see getValueFromTuple in JoinHashTable
@@ -635,6 +1055,13 @@ public:
 
     shared_ptr<Array> finalize()
     {
+        shared_ptr<PhaseTimer> writeTimer;
+        if(_probeTimer.get())
+        {
+            _probeTimer->addRows(_numMatches);
+            _probeTimer->stop();
+            writeTimer.reset(new PhaseTimer(_settings.getProfile(), Profile::WRITE));
+        }
         for(size_t i =0; i<_numAttributes+1; ++i)
         {
             if(_chunkIterators[i].get())
@@ -644,6 +1071,12 @@ public:
             _chunkIterators[i].reset();
             _arrayIterators[i].reset();
         }
+        if(writeTimer.get())
+        {
+            size_t const numWritten = _outputPosition[1];
+            writeTimer->addRows(numWritten);
+            writeTimer->addBytes(numWritten * JoinHashTable::computeTupleOverhead(_output->getArrayDesc().getAttributes(true)));
+        }
         shared_ptr<Array> result = _output;
         _output.reset();
         return result;
@@ -662,6 +1095,9 @@ template<Handedness WHICH, ReadArrayType MODE, bool INCLUDE_NULL_TUPLES = false>
 class ArrayReader
 {
 private:
+    static size_t const BLOOM_SAMPLE_TUPLES        = 65536;   //tuples probed before deciding if the bloom filter pays
+    static size_t const BLOOM_MIN_EXCLUDED_INVERSE = 20;      //it does if it excludes at least 1 in 20 of them
+
     shared_ptr<Array>                       _input;
     Settings const&                         _settings;
     size_t const                            _nAttrs;   //internal: corresponds to num actual attributes
@@ -680,6 +1116,16 @@ private:
     size_t                                  _tuplesAvailable;
     size_t                                  _tuplesExcludedNull;
     size_t                                  _tuplesExcludedBloom;
+    size_t                                  _tuplesProbedBloom;
+    bool                                    _bloomProbing;    //until the sample shows the bloom filter excludes too few
+    vector<size_t>                          _probeAttrs;      //READ_SORTED: the keys and the hash, used by skipTo
+    vector<shared_ptr<ConstArrayIterator> > _probeAiters;
+    vector<shared_ptr<ConstChunkIterator> > _probeCiters;
+    vector<Value const*>                    _probeTuple;
+    Coordinate                              _probeChunkIdx;
+    Coordinate                              _probeChunkCount;
+    size_t                                  _skips;
+    size_t                                  _tuplesSkipped;
 
 public:
     ArrayReader( shared_ptr<Array>& input, Settings const& settings,
@@ -702,7 +1148,14 @@ public:
         _chunksExcluded(0),
         _tuplesAvailable(0),
         _tuplesExcludedNull(0),
-        _tuplesExcludedBloom(0)
+        _tuplesExcludedBloom(0),
+        _tuplesProbedBloom(0),
+        _bloomProbing(readBloomFilter != NULL),
+        _probeTuple(_tuple.size(), NULL),
+        _probeChunkIdx(-1),
+        _probeChunkCount(0),
+        _skips(0),
+        _tuplesSkipped(0)
     {
         Dimensions const& dims = _input->getArrayDesc().getDimensions();
         if(MODE == READ_SORTED && (dims.size()!=1 || dims[0].getStartMin() != 0))
@@ -721,8 +1174,14 @@ public:
         for(const auto& attr : _input->getArrayDesc().getAttributes(true))
         {
             _aiters[i] = _input->getConstIterator(attr);
+            if(MODE == READ_SORTED && (i < _numKeys || i == _nAttrs-1))
+            {
+                _probeAttrs.push_back(i);
+                _probeAiters.push_back(_input->getConstIterator(attr));
+            }
             i++;
         }
+        _probeCiters.resize(_probeAiters.size());
         if(!end())
         {
             next<true>();
@@ -766,14 +1225,39 @@ private:
                 }
             }
         }
-        if(_readBloomFilter && _readBloomFilter->hasTuple(_tuple, _numKeys) == false) //now run through the bloom filter, if any
+        if(_bloomProbing) //now run through the bloom filter, if any
         {
-            ++_tuplesExcludedBloom;
-            return false;
+            if(_tuplesProbedBloom == BLOOM_SAMPLE_TUPLES && !bloomFilterPays())
+            {
+                return true;
+            }
+            ++_tuplesProbedBloom;
+            if(_readBloomFilter->hasTuple(_tuple, _numKeys) == false)
+            {
+                ++_tuplesExcludedBloom;
+                return false;
+            }
         }
         return true; //we got a valid tuple!
     }
 
+    /**
+     * Probing costs two hashes a tuple; excluding one saves tupling, sending, sorting and probing it. Below about one
+     * exclusion in BLOOM_MIN_EXCLUDED_INVERSE probes - keys that mostly match, or a saturated filter - the probes cost
+     * more than they save, so the rest of the scan goes unfiltered. The result is the same either way.
+     * @return false, having stopped probing, if the sample excluded too few tuples
+     */
+    bool bloomFilterPays()
+    {
+        if(_tuplesExcludedBloom * BLOOM_MIN_EXCLUDED_INVERSE >= _tuplesProbedBloom)
+        {
+            return true;
+        }
+        LOG4CXX_DEBUG(logger, "EJ bloom filter excluded "<<_tuplesExcludedBloom<<" of the first "<<_tuplesProbedBloom<<" tuples; probing it no more");
+        _bloomProbing = false;
+        return false;
+    }
+
     bool findNextTupleInChunk()
     {
         while(!_citers[0]->end())
@@ -853,12 +1337,20 @@ public:
         return _aiters[0]->end();
     }
 
+    /**
+     * Log the counts of the scan, and add those of the filters it applied to the profile.
+     */
     void logStats()
     {
         string const which = WHICH == LEFT ? "left" : "right";
         string const mode  = MODE == READ_INPUT ? "input" : MODE ==READ_TUPLED ? "tupled" : "sorted";
         LOG4CXX_DEBUG(logger, "EJ Array Read "<<which<<" "<< mode<< " total chunks "<<_chunksAvailable<<" chunks excluded "<<_chunksExcluded<<" tuples in included chunks "<<_tuplesAvailable<<
-                " NULL tuples excluded "<<_tuplesExcludedNull<<" Bloom filter tuples excluded "<<_tuplesExcludedBloom);
+                " NULL tuples excluded "<<_tuplesExcludedNull<<" Bloom filter tuples probed "<<_tuplesProbedBloom<<" excluded "<<_tuplesExcludedBloom);
+        if(_readChunkFilter || _readBloomFilter)
+        {
+            _settings.getProfile().addFilterProbes(_readChunkFilter ? _chunksAvailable : 0, _chunksExcluded, _tuplesProbedBloom, _tuplesExcludedBloom,
+                                                   _readBloomFilter && !_bloomProbing);
+        }
     }
 
     vector<Value const*> const& getTuple()
@@ -886,15 +1378,16 @@ public:
             throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
         }
         Coordinates pos (1,idx);
-        if(!end() && idx % _chunkSize == _currChunkIdx) //easy
+        if(!end() && idx - idx % _chunkSize == _currChunkIdx) //easy
         {
             for(size_t i=0; i<_nAttrs; ++i)
             {
-                if(!_citers[i]->setPosition(pos) || !setAndCheckTuple())
+                if(!_citers[i]->setPosition(pos))
                 {
                     throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
                 }
             }
+            setAndCheckTuple();
         }
         else
         {
@@ -918,6 +1411,1256 @@ public:
             setAndCheckTuple();
         }
     }
+
+private:
+    /**
+     * Point _probeTuple at the keys and hash of the cell at idx, decoding only those attributes of its chunk.
+     * Returns false if idx is past the end of the array.
+     */
+    bool probe(Coordinate const idx)
+    {
+        Coordinates pos (1, idx);
+        Coordinate const chunkIdx = idx - idx % _chunkSize;
+        if(chunkIdx != _probeChunkIdx)
+        {
+            _probeChunkIdx = -1;
+            for(size_t j=0; j<_probeAiters.size(); ++j)
+            {
+                _probeCiters[j].reset();
+                if(!_probeAiters[j]->setPosition(pos))
+                {
+                    return false;
+                }
+            }
+            for(size_t j=0; j<_probeAiters.size(); ++j)
+            {
+                _probeCiters[j] = _probeAiters[j]->getChunk().getConstIterator();
+            }
+            _probeChunkIdx = chunkIdx;
+            _probeChunkCount = _probeAiters[0]->getChunk().count();
+        }
+        if(idx - chunkIdx >= _probeChunkCount)
+        {
+            return false;
+        }
+        for(size_t j=0; j<_probeAiters.size(); ++j)
+        {
+            if(!_probeCiters[j]->setPosition(pos))
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+            }
+            _probeTuple[_probeAttrs[j]] = &(_probeCiters[j]->getItem());
+        }
+        return true;
+    }
+
+    template <typename TUPLE_TYPE>
+    bool probeLess(TUPLE_TYPE const& target, uint32_t const targetHash) const
+    {
+        uint32_t const hash = _probeTuple[_nAttrs-1]->getUint32();
+        if(hash != targetHash)
+        {
+            return hash < targetHash;
+        }
+        return JoinHashTable::keysLess(_probeTuple, target, _settings.getKeyComparators(), _numKeys);
+    }
+
+public:
+    /**
+     * Move forward to the first tuple that is not less than target in (hash, keys) order. Gallops from the current
+     * position with doubling steps; when a probe lands in a chunk, the last cell of that chunk is checked so that a
+     * chunk that is entirely below the target is passed over at once. Only the key and hash attributes of the probed
+     * chunks are read. Not for arrays with null keys.
+     */
+    template <typename TUPLE_TYPE>
+    void skipTo(TUPLE_TYPE const& target, uint32_t const targetHash)
+    {
+        if(MODE != READ_SORTED || end())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        Coordinate const start = getIdx();
+        if(!probe(start) || !probeLess(target, targetHash))
+        {
+            return;
+        }
+        Coordinate lo = start;  //always less than target
+        Coordinate hi = -1;     //never less than target, or past the end
+        Coordinate step = 1;
+        while(hi < 0)
+        {
+            Coordinate const idx = lo + step;
+            if(!probe(idx) || !probeLess(target, targetHash))
+            {
+                hi = idx;
+                break;
+            }
+            lo = idx;
+            Coordinate const chunkLast = _probeChunkIdx + _probeChunkCount - 1;
+            if(chunkLast > lo)
+            {
+                probe(chunkLast);
+                if(probeLess(target, targetHash))
+                {
+                    lo = chunkLast;
+                }
+                else
+                {
+                    hi = chunkLast;
+                }
+            }
+            step *= 2;
+        }
+        while(hi - lo > 1)
+        {
+            Coordinate const mid = lo + (hi - lo) / 2;
+            if(probe(mid) && probeLess(target, targetHash))
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        ++_skips;
+        _tuplesSkipped += hi - start;
+        if(probe(hi))
+        {
+            setIdx(hi);
+        }
+        else
+        {
+            setIdx(lo);
+            next();
+        }
+    }
+
+    void logSkipStats()
+    {
+        string const which = WHICH == LEFT ? "left" : "right";
+        LOG4CXX_DEBUG(logger, "EJ Sorted read "<<which<<" skips "<<_skips<<" tuples skipped "<<_tuplesSkipped);
+    }
+};
+
+/**
+ * Reads the input like ArrayReader<READ_INPUT> and appends the hash to every tuple, so the tuples come out in the
+ * tupled layout. Filters and partitioning samples are populated along the way.
+ */
+template<Handedness WHICH, bool INCLUDE_NULL_TUPLES = false, bool HASH_NULLS = false>
+class TuplingReader
+{
+private:
+    ArrayReader<WHICH, READ_INPUT, INCLUDE_NULL_TUPLES> _reader;
+    ChunkFilter<WHICH>*                     _chunkFilterToGenerate;
+    BloomFilter*                            _bloomFilterToGenerate;
+    HashPartitioning*                       _partitioningToSample;
+    HyperLogLog*                            _sketchToGenerate;
+    size_t const                            _numKeys;
+    uint32_t const                          _hashMod;
+    vector<char>                            _hashBuf;
+    Value                                   _hashVal;
+    vector<Value const*>                    _tuple;
+
+    void setTuple()
+    {
+        vector<Value const*> const& tuple = _reader.getTuple();
+        if(_chunkFilterToGenerate)
+        {
+            _chunkFilterToGenerate->addTuple(tuple);
+        }
+        if(_bloomFilterToGenerate)
+        {
+            _bloomFilterToGenerate->addTuple(tuple, _numKeys);
+        }
+        uint32_t const hash = JoinHashTable::hashKeys<HASH_NULLS>(tuple, _numKeys, _hashBuf);
+        if(_sketchToGenerate)
+        {
+            _sketchToGenerate->addHash(hash);
+        }
+        _hashVal.setUint32(hash % _hashMod);
+        if(_partitioningToSample)
+        {
+            _partitioningToSample->addHash(_hashVal.getUint32());
+        }
+        for(size_t i=0; i<tuple.size(); ++i)
+        {
+            _tuple[i] = tuple[i];
+        }
+    }
+
+public:
+    TuplingReader(shared_ptr<Array>& input, Settings const& settings,
+                  ChunkFilter<WHICH>* chunkFilterToGenerate, ChunkFilter<WHICH == LEFT ? RIGHT : LEFT> const* chunkFilterToApply,
+                  BloomFilter* bloomFilterToGenerate,        BloomFilter const* bloomFilterToApply,
+                  HashPartitioning* partitioningToSample = NULL, HyperLogLog* sketchToGenerate = NULL):
+        _reader(input, settings, chunkFilterToApply, bloomFilterToApply),
+        _chunkFilterToGenerate(chunkFilterToGenerate),
+        _bloomFilterToGenerate(bloomFilterToGenerate),
+        _partitioningToSample(partitioningToSample),
+        _sketchToGenerate(sketchToGenerate),
+        _numKeys(settings.getNumKeys()),
+        _hashMod(safe_static_cast<uint32_t>(settings.getNumHashBuckets())),
+        _hashBuf(64),
+        _tuple((WHICH == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize()) + 1, NULL)
+    {
+        _tuple[_tuple.size()-1] = &_hashVal;
+        if(!_reader.end())
+        {
+            setTuple();
+        }
+    }
+
+    bool end()
+    {
+        return _reader.end();
+    }
+
+    void next()
+    {
+        _reader.next();
+        if(!_reader.end())
+        {
+            setTuple();
+        }
+    }
+
+    vector<Value const*> const& getTuple()
+    {
+        return _tuple;
+    }
+
+    void logStats()
+    {
+        _reader.logStats();
+    }
+};
+
+/**
+ * A single-pass tupled array (schema as in makeTupledSchema) whose chunks are made on demand as the consumer - the
+ * redistribution or the sort - pulls them. Tuples come from a SOURCE (TuplingReader or ArrayReader<READ_TUPLED>).
+ * With a HashPartitioning, each tuple goes to the dst_instance_id chunk picked by its hash and heavy hashes are either
+ * broadcast or spread round-robin; without one, everything goes to dst_instance_id 0 like ArrayWriter<WRITE_TUPLED>.
+ * Each partition holds at most one chunk of tuples, which becomes the next row as soon as it fills up, so the memory
+ * used is one chunk per instance and the input order is kept within a partition. That memory, the out-of-line bytes of
+ * the buffered values and the two rows of chunks included, is charged to the memory budget.
+ */
+template<typename SOURCE>
+class TupledArrayStream : public SinglePassArray
+{
+private:
+    typedef SinglePassArray super;
+    SOURCE&                                 _source;
+    shared_ptr<Query>                       _query;
+    InstanceID const                        _myInstanceId;
+    size_t const                            _numPartitions;
+    size_t const                            _nAttrs;         //plus hash
+    Coordinate const                        _chunkSize;
+    CompressorType const                    _compression;
+    HashPartitioning const*                 _partitioning;
+    bool const                              _broadcastHeavy;
+    size_t                                  _nextHeavyPartition;
+    vector<vector<Value> >                  _buffers;        //one chunk of tuples per partition
+    vector<Coordinate>                      _nextValueNo;    //per partition
+    std::deque<size_t>                      _fullPartitions;
+    size_t                                  _rowIndex;
+    vector<vector<shared_ptr<MemChunk> > >  _rows;           //current and previous row, one chunk per attribute
+    Value                                   _boolTrue;
+    size_t                                  _chunksSent;
+    size_t const                            _bufferSlotBytes; //the Values reserved for every partition
+    vector<size_t>                          _bufferVarBytes;  //out-of-line bytes of the values held, per partition
+    size_t                                  _varBytes;
+    size_t                                  _rowBytes[2];
+    size_t                                  _tuplesUncharged;
+    MemoryCharge                            _charge;
+
+    void updateCharge()
+    {
+        _charge.resize(_bufferSlotBytes + _varBytes + _rowBytes[0] + _rowBytes[1]);
+        _tuplesUncharged = 0;
+    }
+
+    void route(vector<Value const*> const& tuple)
+    {
+        if(_partitioning == NULL)
+        {
+            addToPartition(tuple, 0);
+            return;
+        }
+        uint32_t const hash = tuple[_nAttrs-1]->getUint32();
+        if(_partitioning->isHeavy(hash))
+        {
+            if(_broadcastHeavy)
+            {
+                for(size_t p=0; p<_numPartitions; ++p)
+                {
+                    addToPartition(tuple, p);
+                }
+            }
+            else
+            {
+                addToPartition(tuple, _nextHeavyPartition);
+                _nextHeavyPartition = (_nextHeavyPartition + 1) % _numPartitions;
+            }
+            return;
+        }
+        vector<uint32_t> const& breaks = _partitioning->getHashBreaks();
+        addToPartition(tuple, std::lower_bound(breaks.begin(), breaks.end(), hash) - breaks.begin());
+    }
+
+    void addToPartition(vector<Value const*> const& tuple, size_t const p)
+    {
+        vector<Value>& buffer = _buffers[p];
+        for(size_t i=0; i<_nAttrs; ++i)
+        {
+            buffer.push_back(*(tuple[i]));
+            if(tuple[i]->size() > sizeof(void*))
+            {
+                _bufferVarBytes[p] += tuple[i]->size();
+                _varBytes          += tuple[i]->size();
+            }
+        }
+        if(static_cast<Coordinate>(buffer.size() / _nAttrs) == _chunkSize)
+        {
+            _fullPartitions.push_back(p);
+        }
+        if(++_tuplesUncharged == 1024)
+        {
+            updateCharge();
+        }
+    }
+
+    void makeRow(size_t const p, vector<shared_ptr<MemChunk> >& row)
+    {
+        vector<Value>& buffer = _buffers[p];
+        Coordinates pos(3);
+        pos[0] = p;
+        pos[1] = _myInstanceId;
+        pos[2] = _nextValueNo[p];
+        size_t const numTuples = buffer.size() / _nAttrs;
+        for(size_t i=0; i<_nAttrs+1; ++i)
+        {
+            row[i].reset(new MemChunk());
+            Address addr(safe_static_cast<AttributeID>(i), pos);
+            row[i]->initialize(this, &super::getArrayDesc(), addr, i < _nAttrs ? _compression : CompressorType::NONE);
+            shared_ptr<ChunkIterator> citer = row[i]->getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE | ChunkIterator::NO_EMPTY_CHECK);
+            Coordinates cellPos(pos);
+            for(size_t t=0; t<numTuples; ++t)
+            {
+                citer->setPosition(cellPos);
+                citer->writeItem(i < _nAttrs ? buffer[t * _nAttrs + i] : _boolTrue);
+                ++cellPos[2];
+            }
+            citer->flush();
+        }
+        _nextValueNo[p] += _chunkSize;
+        buffer.clear();
+        _varBytes -= _bufferVarBytes[p];
+        _bufferVarBytes[p] = 0;
+        size_t& rowBytes = _rowBytes[&row == &_rows[0] ? 0 : 1];
+        rowBytes = 0;
+        for(size_t i=0; i<_nAttrs+1; ++i)
+        {
+            rowBytes += row[i]->getSize();
+        }
+        updateCharge();
+        ++_chunksSent;
+    }
+
+public:
+    TupledArrayStream(ArrayDesc const& schema, SOURCE& source, shared_ptr<Query> const& query, Settings const& settings,
+                           HashPartitioning const* partitioning, bool const broadcastHeavy = false):
+        super(schema),
+        _source(source),
+        _query(query),
+        _myInstanceId(query->getInstanceID()),
+        _numPartitions(partitioning ? query->getInstancesCount() : 1),
+        _nAttrs(schema.getAttributes(true).size()),
+        _chunkSize(settings.getChunkSize()),
+        _compression(settings.getShuffleCompression()),
+        _partitioning(partitioning),
+        _broadcastHeavy(broadcastHeavy),
+        _nextHeavyPartition(_myInstanceId % _numPartitions),
+        _buffers(_numPartitions),
+        _nextValueNo(_numPartitions, 0),
+        _rowIndex(0),
+        _rows(2, vector<shared_ptr<MemChunk> >(_nAttrs+1)),
+        _chunksSent(0),
+        _bufferSlotBytes(_numPartitions * _chunkSize * _nAttrs * sizeof(Value)),
+        _bufferVarBytes(_numPartitions, 0),
+        _varBytes(0),
+        _tuplesUncharged(0),
+        _charge(settings.getMemoryUsage(), "partition buffers", _bufferSlotBytes)
+    {
+        super::setEnforceHorizontalIteration(true);
+        _boolTrue.setBool(true);
+        _rowBytes[0] = 0;
+        _rowBytes[1] = 0;
+        for(size_t p=0; p<_numPartitions; ++p)
+        {
+            _buffers[p].reserve(_chunkSize * _nAttrs);
+        }
+    }
+
+    size_t getCurrentRowIndex() const override
+    {
+        return _rowIndex;
+    }
+
+    bool moveNext(size_t rowIndex) override
+    {
+        while(_fullPartitions.empty() && !_source.end())
+        {
+            route(_source.getTuple());
+            _source.next();
+        }
+        size_t partition = _numPartitions;
+        if(!_fullPartitions.empty())
+        {
+            partition = _fullPartitions.front();
+            _fullPartitions.pop_front();
+        }
+        else
+        {
+            for(size_t p=0; p<_numPartitions && partition == _numPartitions; ++p)
+            {
+                if(_buffers[p].size())
+                {
+                    partition = p;
+                }
+            }
+        }
+        if(partition == _numPartitions)
+        {
+            LOG4CXX_DEBUG(logger, "EJ tupled stream produced "<<_chunksSent<<" chunks in "<<_numPartitions<<" partitions");
+            return false;
+        }
+        ++_rowIndex;
+        makeRow(partition, _rows[_rowIndex % 2]);
+        return true;
+    }
+
+    ConstChunk const& getChunk(AttributeID attr, size_t rowIndex) override
+    {
+        if(rowIndex != _rowIndex && rowIndex + 1 != _rowIndex)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        return *(_rows[rowIndex % 2][attr]);
+    }
+};
+
+/**
+ * Reads a tupled array after redistribution, when every src_instance_id slice that arrived here is a run that was
+ * sorted on (hash, keys) by its sender. The runs are merged on a heap, so the tuples come out in (hash, keys) order
+ * without sorting the array again. Tuples with null keys (outer joins only) are placed ahead of everything else
+ * with the same hash.
+ */
+template<Handedness WHICH>
+class RunMergeReader
+{
+private:
+    struct Run
+    {
+        vector<shared_ptr<ConstArrayIterator> > aiters;
+        vector<shared_ptr<ConstChunkIterator> > citers;
+        Coordinates                             chunkPos;
+        Coordinates                             cellPos;
+        Coordinate                              chunkCount;
+        vector<Value const*>                    tuple;
+        bool                                    done;
+    };
+
+    shared_ptr<Array>                       _input;
+    Settings const&                         _settings;
+    size_t const                            _nAttrs;
+    size_t const                            _numKeys;
+    Coordinate const                        _chunkSize;
+    vector<AttributeComparator> const&      _comparators;
+    vector<Run>                             _runs;
+    vector<size_t>                          _heap;     //runs that still have tuples; the front is the current tuple
+    size_t                                  _tuplesAvailable;
+    size_t                                  _skips;
+    size_t                                  _tuplesSkipped;
+
+public:
+    RunMergeReader(shared_ptr<Array>& input, Settings const& settings):
+        _input(input),
+        _settings(settings),
+        _nAttrs( input->getArrayDesc().getAttributes(true).size()),
+        _numKeys(settings.getNumKeys()),
+        _chunkSize(input->getArrayDesc().getDimensions()[2].getChunkInterval()),
+        _comparators(settings.getKeyComparators()),
+        _tuplesAvailable(0),
+        _skips(0),
+        _tuplesSkipped(0)
+    {
+        Dimensions const& dims = _input->getArrayDesc().getDimensions();
+        if(dims.size() != 3 || _nAttrs != (WHICH == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize()) + 1)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        size_t const numRuns = dims[1].getEndMax() + 1;
+        _runs.resize(numRuns);
+        Coordinate dstInstance = 0;
+        for(size_t r=0; r<numRuns; ++r)
+        {
+            Run& run = _runs[r];
+            run.aiters.resize(_nAttrs);
+            run.citers.resize(_nAttrs);
+            run.tuple.resize(_nAttrs);
+            run.chunkPos.resize(3, 0);
+            run.cellPos.resize(3, 0);
+            run.chunkCount = 0;
+            run.done = true;
+            size_t i = 0;
+            for(const auto& attr : _input->getArrayDesc().getAttributes(true))
+            {
+                run.aiters[i] = _input->getConstIterator(attr);
+                i++;
+            }
+            if(r == 0 && !run.aiters[0]->end())
+            {
+                dstInstance = run.aiters[0]->getPosition()[0]; //all the chunks here are addressed to us
+            }
+            run.chunkPos[0] = dstInstance;
+            run.chunkPos[1] = r;
+        }
+        for(size_t r=0; r<numRuns; ++r)
+        {
+            if(openChunk(_runs[r]))
+            {
+                setTuple(_runs[r]);
+                _heap.push_back(r);
+                pushHeap();
+            }
+        }
+        if(!end())
+        {
+            ++_tuplesAvailable;
+        }
+    }
+
+private:
+    bool openChunk(Run& run)
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            run.citers[i].reset();
+            if(!run.aiters[i]->setPosition(run.chunkPos))
+            {
+                run.done = true;
+                return false;
+            }
+        }
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            run.citers[i] = run.aiters[i]->getChunk().getConstIterator();
+        }
+        if(run.citers[0]->end())
+        {
+            run.done = true;
+            return false;
+        }
+        run.chunkCount = run.aiters[0]->getChunk().count();
+        run.done = false;
+        return true;
+    }
+
+    void setTuple(Run& run)
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            run.tuple[i] = &(run.citers[i]->getItem());
+        }
+    }
+
+    void advance(Run& run)
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            ++(*run.citers[i]);
+        }
+        if(run.citers[0]->end())
+        {
+            run.chunkPos[2] += _chunkSize;
+            if(!openChunk(run))
+            {
+                return;
+            }
+        }
+        setTuple(run);
+    }
+
+    bool runLess(size_t const a, size_t const b) const
+    {
+        vector<Value const*> const& left  = _runs[a].tuple;
+        vector<Value const*> const& right = _runs[b].tuple;
+        uint32_t const leftHash  = left [_nAttrs-1]->getUint32();
+        uint32_t const rightHash = right[_nAttrs-1]->getUint32();
+        if(leftHash != rightHash)
+        {
+            return leftHash < rightHash;
+        }
+        bool const leftNull  = isNullTuple(left,  _numKeys);
+        bool const rightNull = isNullTuple(right, _numKeys);
+        if(leftNull || rightNull)
+        {
+            return leftNull && !rightNull;
+        }
+        return JoinHashTable::keysLess(left, right, _comparators, _numKeys);
+    }
+
+    template <typename TUPLE_TYPE>
+    bool tupleLess(vector<Value const*> const& tuple, TUPLE_TYPE const& target, uint32_t const targetHash) const
+    {
+        uint32_t const hash = tuple[_nAttrs-1]->getUint32();
+        if(hash != targetHash)
+        {
+            return hash < targetHash;
+        }
+        return JoinHashTable::keysLess(tuple, target, _comparators, _numKeys);
+    }
+
+    /**
+     * Point the keys and hash of the run's tuple at the cell value_no idx of its current chunk, and compare them with
+     * the target. The other attributes are left where they were.
+     */
+    template <typename TUPLE_TYPE>
+    bool cellLess(Run& run, Coordinate const idx, TUPLE_TYPE const& target, uint32_t const targetHash)
+    {
+        run.cellPos = run.chunkPos;
+        run.cellPos[2] = idx;
+        for(size_t i =0; i<=_numKeys; ++i)
+        {
+            size_t const attr = (i == _numKeys ? _nAttrs-1 : i);
+            if(!run.citers[attr]->setPosition(run.cellPos))
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+            }
+            run.tuple[attr] = &(run.citers[attr]->getItem());
+        }
+        return tupleLess(run.tuple, target, targetHash);
+    }
+
+    /**
+     * Move a run that is below the target to its first tuple that is not, without going through the heap. A run
+     * is sorted and its cells are numbered without gaps, so the last cell of a chunk is its greatest tuple: chunks
+     * that end below the target are passed over after one comparison. In the chunk where the target falls, gallop
+     * from the current cell with doubling steps, then binary search. Returns false if the run ran out.
+     */
+    template <typename TUPLE_TYPE>
+    bool gallop(Run& run, TUPLE_TYPE const& target, uint32_t const targetHash)
+    {
+        Coordinate const start = run.citers[0]->getPosition()[2];
+        Coordinate lo = start;  //always less than target
+        Coordinate last = run.chunkPos[2] + run.chunkCount - 1;
+        while(cellLess(run, last, target, targetHash))
+        {
+            run.chunkPos[2] += _chunkSize;
+            if(!openChunk(run))
+            {
+                _tuplesSkipped += last + 1 - start;
+                return false;
+            }
+            lo   = run.chunkPos[2] - 1;
+            last = run.chunkPos[2] + run.chunkCount - 1;
+        }
+        Coordinate hi = last;   //never less than target
+        Coordinate step = 1;
+        while(lo + step < hi)
+        {
+            if(!cellLess(run, lo + step, target, targetHash))
+            {
+                hi = lo + step;
+                break;
+            }
+            lo += step;
+            step *= 2;
+        }
+        while(hi - lo > 1)
+        {
+            Coordinate const mid = lo + (hi - lo) / 2;
+            if(cellLess(run, mid, target, targetHash))
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        run.cellPos = run.chunkPos;
+        run.cellPos[2] = hi;
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            if(!run.citers[i]->setPosition(run.cellPos))
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+            }
+        }
+        setTuple(run);
+        _tuplesSkipped += hi - start;
+        return true;
+    }
+
+    //heap order is reversed: the run with the least tuple goes on top
+    void pushHeap()
+    {
+        std::push_heap(_heap.begin(), _heap.end(), [this](size_t a, size_t b) { return runLess(b, a); });
+    }
+
+    void popHeap()
+    {
+        std::pop_heap(_heap.begin(), _heap.end(), [this](size_t a, size_t b) { return runLess(b, a); });
+    }
+
+public:
+    bool end() const
+    {
+        return _heap.empty();
+    }
+
+    void next()
+    {
+        if(end())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        popHeap();
+        size_t const r = _heap.back();
+        advance(_runs[r]);
+        if(_runs[r].done)
+        {
+            _heap.pop_back();
+        }
+        else
+        {
+            pushHeap();
+        }
+        if(!end())
+        {
+            ++_tuplesAvailable;
+        }
+    }
+
+    vector<Value const*> const& getTuple() const
+    {
+        if(end())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        return _runs[_heap.front()].tuple;
+    }
+
+    /**
+     * Same contract as ArrayReader<READ_SORTED>::skipTo. While the least run is below the target, it is taken off the
+     * heap and moved forward on its own, then put back: see gallop.
+     */
+    template <typename TUPLE_TYPE>
+    void skipTo(TUPLE_TYPE const& target, uint32_t const targetHash)
+    {
+        bool moved = false;
+        while(!end() && tupleLess(_runs[_heap.front()].tuple, target, targetHash))
+        {
+            popHeap();
+            size_t const r = _heap.back();
+            if(!gallop(_runs[r], target, targetHash))
+            {
+                _heap.pop_back();
+            }
+            else
+            {
+                pushHeap();
+            }
+            moved = true;
+        }
+        if(moved)
+        {
+            ++_skips;
+            if(!end())
+            {
+                ++_tuplesAvailable;
+            }
+        }
+    }
+
+    void logSkipStats()
+    {
+        string const which = WHICH == LEFT ? "left" : "right";
+        LOG4CXX_DEBUG(logger, "EJ Run merge "<<which<<" skips "<<_skips<<" tuples skipped "<<_tuplesSkipped);
+    }
+
+    void logStats()
+    {
+        string const which = WHICH == LEFT ? "left" : "right";
+        LOG4CXX_DEBUG(logger, "EJ Array Read "<<which<<" merged runs "<<_runs.size()<<" tuples "<<_tuplesAvailable);
+    }
+};
+
+/**
+ * Reads an input array one chunk at a time, chosen by position, making tuples the way ArrayReader<READ_INPUT> does.
+ * For the aligned chunk join, where the two arrays have the same chunk grid and each chunk of one pairs with the chunk
+ * at the same position of the other. Cells come in the chunk iterator's order, row-major, which is the same for both.
+ */
+template<Handedness WHICH>
+class ChunkCellReader
+{
+private:
+    shared_ptr<Array>                       _input;
+    Settings const&                         _settings;
+    size_t const                            _nAttrs;
+    size_t const                            _nDims;
+    vector<shared_ptr<ConstArrayIterator> > _aiters;
+    vector<shared_ptr<ConstChunkIterator> > _citers;
+    vector<Value const*>                    _tuple;
+    vector<Value>                           _dimVals;
+    bool                                    _inChunk;
+
+public:
+    ChunkCellReader(shared_ptr<Array>& input, Settings const& settings):
+        _input(input),
+        _settings(settings),
+        _nAttrs(input->getArrayDesc().getAttributes(true).size()),
+        _nDims(input->getArrayDesc().getDimensions().size()),
+        _aiters(_nAttrs),
+        _citers(_nAttrs),
+        _tuple(WHICH == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize(), NULL),
+        _dimVals(_nDims),
+        _inChunk(false)
+    {
+        size_t i = 0;
+        for(const auto& attr : _input->getArrayDesc().getAttributes(true))
+        {
+            _aiters[i] = _input->getConstIterator(attr);
+            i++;
+        }
+    }
+
+    /**
+     * @return false if the array has no chunk at chunkPos
+     */
+    bool setChunk(Coordinates const& chunkPos)
+    {
+        _inChunk = false;
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            _citers[i].reset();
+            if(!_aiters[i]->setPosition(chunkPos))
+            {
+                return false;
+            }
+            _citers[i] = _aiters[i]->getChunk().getConstIterator();
+        }
+        _inChunk = true;
+        return true;
+    }
+
+    /**
+     * Move to a cell of the current chunk.
+     * @return false if the cell is empty
+     */
+    bool setCell(Coordinates const& cellPos)
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            if(!_citers[i]->setPosition(cellPos))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool end() const
+    {
+        return !_inChunk || _citers[0]->end();
+    }
+
+    void next()
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            ++(*_citers[i]);
+        }
+    }
+
+    Coordinates const& getPosition() const
+    {
+        return _citers[0]->getPosition();
+    }
+
+    vector<Value const*> const& getTuple()
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            size_t idx = WHICH == LEFT ? _settings.mapLeftToTuple(i) : _settings.mapRightToTuple(i);
+            _tuple[idx] = &(_citers[i]->getItem());
+        }
+        Coordinates const& pos = _citers[0]->getPosition();
+        for(size_t i = 0; i<_nDims; ++i)
+        {
+            ssize_t idx = (WHICH == LEFT ? _settings.mapLeftToTuple(i + _nAttrs) : _settings.mapRightToTuple(i + _nAttrs));
+            if(idx >= 0)
+            {
+                _dimVals[i].setInt64(pos[i]);
+                _tuple [ idx ] = &_dimVals[i];
+            }
+        }
+        return _tuple;
+    }
+
+    /**
+     * Row-major comparison of two cell positions.
+     */
+    static int compareCells(Coordinates const& a, Coordinates const& b)
+    {
+        for(size_t i=0; i<a.size(); ++i)
+        {
+            if(a[i] != b[i])
+            {
+                return a[i] < b[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+};
+
+/**
+ * Reads every attribute (except the empty tag) of any array, in chunk order. For the late materialization arrays,
+ * which don't have the tupled layout ArrayReader expects.
+ */
+class FlatArrayReader
+{
+private:
+    shared_ptr<Array>                       _input;
+    size_t const                            _nAttrs;
+    vector<shared_ptr<ConstArrayIterator> > _aiters;
+    vector<shared_ptr<ConstChunkIterator> > _citers;
+    vector<Value const*>                    _tuple;
+
+    void setTuple()
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            _tuple[i] = &(_citers[i]->getItem());
+        }
+    }
+
+    void findNonEmptyChunk()
+    {
+        while(!_aiters[0]->end())
+        {
+            for(size_t i =0; i<_nAttrs; ++i)
+            {
+                _citers[i] = _aiters[i]->getChunk().getConstIterator();
+            }
+            if(!_citers[0]->end())
+            {
+                setTuple();
+                return;
+            }
+            for(size_t i =0; i<_nAttrs; ++i)
+            {
+                ++(*_aiters[i]);
+            }
+        }
+    }
+
+public:
+    FlatArrayReader(shared_ptr<Array>& input):
+        _input(input),
+        _nAttrs(input->getArrayDesc().getAttributes(true).size()),
+        _aiters(_nAttrs),
+        _citers(_nAttrs),
+        _tuple(_nAttrs, NULL)
+    {
+        size_t i = 0;
+        for(const auto& attr : _input->getArrayDesc().getAttributes(true))
+        {
+            _aiters[i] = _input->getConstIterator(attr);
+            i++;
+        }
+        findNonEmptyChunk();
+    }
+
+    bool end()
+    {
+        return _aiters[0]->end();
+    }
+
+    void next()
+    {
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            ++(*_citers[i]);
+        }
+        if(!_citers[0]->end())
+        {
+            setTuple();
+            return;
+        }
+        for(size_t i =0; i<_nAttrs; ++i)
+        {
+            ++(*_aiters[i]);
+        }
+        findNonEmptyChunk();
+    }
+
+    vector<Value const*> const& getTuple()
+    {
+        return _tuple;
+    }
+};
+
+/**
+ * For late materialization: tuples a TuplingReader into a local tupled array (the store) and gives out the locator
+ * tuple (see makeLocatorSchema) of each, to be redistributed through a TupledArrayStream.
+ */
+template<typename READER>
+class LocatorSource
+{
+private:
+    READER&                                 _reader;
+    ArrayWriter<WRITE_TUPLED>               _store;
+    size_t const                            _numKeys;
+    Coordinate                              _nextPos;
+    Value                                   _instanceVal;
+    Value                                   _posVal;
+    vector<Value const*>                    _tuple;
+
+    void setTuple()
+    {
+        vector<Value const*> const& tuple = _reader.getTuple();
+        _store.writeTuple(tuple);
+        for(size_t i=0; i<_numKeys; ++i)
+        {
+            _tuple[i] = tuple[i];
+        }
+        _posVal.setInt64(_nextPos++);
+        _tuple[_numKeys+2] = tuple[tuple.size()-1];
+    }
+
+public:
+    LocatorSource(READER& reader, Settings const& settings, shared_ptr<Query> const& query, ArrayDesc const& storeSchema):
+        _reader(reader),
+        _store(settings, query, storeSchema),
+        _numKeys(settings.getNumKeys()),
+        _nextPos(0),
+        _tuple(_numKeys+3, NULL)
+    {
+        _instanceVal.setInt64(query->getInstanceID());
+        _tuple[_numKeys]   = &_instanceVal;
+        _tuple[_numKeys+1] = &_posVal;
+        if(!_reader.end())
+        {
+            setTuple();
+        }
+    }
+
+    bool end()
+    {
+        return _reader.end();
+    }
+
+    void next()
+    {
+        _reader.next();
+        if(!_reader.end())
+        {
+            setTuple();
+        }
+    }
+
+    vector<Value const*> const& getTuple()
+    {
+        return _tuple;
+    }
+
+    shared_ptr<Array> finalizeStore()
+    {
+        return _store.finalize();
+    }
+};
+
+/**
+ * Random access into a local tupled array written by ArrayWriter<WRITE_TUPLED> on this instance, by value_no.
+ * Chunk iterators are kept for the last chunk fetched from, so when positions are fetched in ascending order (see
+ * sortByPosition), every chunk is opened once and walked forward.
+ */
+class TupleFetcher
+{
+private:
+    shared_ptr<Array>                       _store;
+    size_t const                            _nAttrs;
+    Coordinate const                        _chunkSize;
+    Coordinates                             _pos;
+    Coordinate                              _currChunkIdx;
+    vector<shared_ptr<ConstArrayIterator> > _aiters;
+    vector<shared_ptr<ConstChunkIterator> > _citers;
+    vector<Value const*>                    _tuple;
+
+public:
+    TupleFetcher(shared_ptr<Array>& store, shared_ptr<Query> const& query):
+        _store(store),
+        _nAttrs(store->getArrayDesc().getAttributes(true).size()),
+        _chunkSize(store->getArrayDesc().getDimensions()[2].getChunkInterval()),
+        _pos(3, 0),
+        _currChunkIdx(-1),
+        _aiters(_nAttrs),
+        _citers(_nAttrs),
+        _tuple(_nAttrs, NULL)
+    {
+        _pos[1] = query->getInstanceID();
+        size_t i = 0;
+        for(const auto& attr : _store->getArrayDesc().getAttributes(true))
+        {
+            _aiters[i] = _store->getConstIterator(attr);
+            i++;
+        }
+    }
+
+    vector<Value const*> const& fetch(Coordinate const valueNo)
+    {
+        _pos[2] = valueNo;
+        Coordinate const chunkIdx = valueNo - valueNo % _chunkSize;
+        if(chunkIdx != _currChunkIdx)
+        {
+            _currChunkIdx = -1;
+            for(size_t i=0; i<_nAttrs; ++i)
+            {
+                _citers[i].reset();
+                if(!_aiters[i]->setPosition(_pos))
+                {
+                    throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+                }
+                _citers[i] = _aiters[i]->getChunk().getConstIterator();
+            }
+            _currChunkIdx = chunkIdx;
+        }
+        for(size_t i=0; i<_nAttrs; ++i)
+        {
+            if(!_citers[i]->setPosition(_pos))
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+            }
+            _tuple[i] = &(_citers[i]->getItem());
+        }
+        return _tuple;
+    }
+};
+
+/**
+ * A run of tuples with equal keys, held by the merge join so that it can be replayed for every matching tuple on the
+ * other side. Tuples are kept in memory; once they take more than maxBytes, a run that is allowed to spill is moved
+ * into a tupled MemArray (which SciDB may swap out) and read back with ArrayReader<READ_TUPLED>.
+ */
+template <Handedness WHICH>
+class TupleRun : public boost::noncopyable
+{
+private:
+    Settings const&                          _settings;
+    shared_ptr<Query>                        _query;
+    size_t const                             _tupleSize;   //plus hash
+    size_t const                             _maxBytes;
+    bool const                               _canSpill;
+    vector<Value>                            _values;
+    size_t                                   _numTuples;
+    size_t                                   _usedBytes;
+    shared_ptr<ArrayWriter<WRITE_TUPLED> >   _spillWriter;
+    shared_ptr<Array>                        _spilled;
+
+    void spill()
+    {
+        LOG4CXX_DEBUG(logger, "EJ spilling "<<(WHICH == LEFT ? "left" : "right")<<" run of "<<_numTuples<<" tuples, "<<_usedBytes<<" bytes");
+        _spillWriter.reset(new ArrayWriter<WRITE_TUPLED>(_settings, _query, makeTupledSchema<WHICH>(_settings, _query)));
+        vector<Value const*> tuple(_tupleSize, NULL);
+        for(size_t t=0; t<_numTuples; ++t)
+        {
+            for(size_t i=0; i<_tupleSize; ++i)
+            {
+                tuple[i] = &(_values[t * _tupleSize + i]);
+            }
+            _spillWriter->writeTuple(tuple);
+        }
+        vector<Value>().swap(_values);
+        _usedBytes = 0;
+    }
+
+public:
+    TupleRun(Settings const& settings, shared_ptr<Query> const& query, size_t const maxBytes, bool const canSpill):
+        _settings (settings),
+        _query    (query),
+        _tupleSize((WHICH == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize()) + 1),
+        _maxBytes (maxBytes),
+        _canSpill (canSpill),
+        _numTuples(0),
+        _usedBytes(0)
+    {}
+
+    void clear()
+    {
+        _values.clear();
+        _numTuples = 0;
+        _usedBytes = 0;
+        _spillWriter.reset();
+        _spilled.reset();
+    }
+
+    void add(vector<Value const*> const& tuple)
+    {
+        ++_numTuples;
+        if(_spillWriter.get())
+        {
+            _spillWriter->writeTuple(tuple);
+            return;
+        }
+        for(size_t i=0; i<_tupleSize; ++i)
+        {
+            _values.push_back(*(tuple[i]));
+            _usedBytes += sizeof(Value) + tuple[i]->size();
+        }
+        if(_canSpill && _usedBytes > _maxBytes)
+        {
+            spill();
+        }
+    }
+
+    size_t size() const
+    {
+        return _numTuples;
+    }
+
+    bool isFull() const
+    {
+        return _usedBytes >= _maxBytes;
+    }
+
+    bool isSpilled() const
+    {
+        return _spillWriter.get() || _spilled.get();
+    }
+
+    /**
+     * Only for runs that are not spilled.
+     */
+    Value const* getTuple(size_t const idx) const
+    {
+        return &(_values[idx * _tupleSize]);
+    }
+
+    /**
+     * Only for spilled runs; once called, no more tuples may be added until clear().
+     */
+    shared_ptr<Array>& getSpilled()
+    {
+        if(_spillWriter.get())
+        {
+            _spilled = _spillWriter->finalize();
+            _spillWriter.reset();
+        }
+        return _spilled;
+    }
 };
 
 } } //namespace scidb::equi_join
@@ -34,6 +34,11 @@
 #include <query/AttributeComparator.h>
 #include <system/Config.h>
 #include <boost/algorithm/string.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <time.h>
 
 namespace scidb
 {
@@ -67,6 +72,10 @@ static const char* const KW_FILTER = "filter";
 static const char* const KW_LEFT_OUTER = "left_outer";
 static const char* const KW_RIGHT_OUTER = "right_outer";
 static const char* const KW_OUT_NAMES = "out_names";
+static const char* const KW_SKEW_HANDLING = "skew_handling";
+static const char* const KW_SHUFFLE_COMPRESSION = "shuffle_compression";
+static const char* const KW_EXPLAIN = "explain";
+static const char* const KW_PROFILE = "profile";
 
 typedef std::shared_ptr<OperatorParamLogicalExpression> ParamType_t ;
 
@@ -110,6 +119,735 @@ static size_t chooseNumBuckets(size_t maxTableSize)
    return tableSizes[NUM_SIZES-1];
 }
 
+/**
+ * Fewer buckets for a table that is known to hold only numGroups distinct keys: the smallest prime at or above
+ * numGroups, so the load factor is about 1, but no more than maxBuckets.
+ */
+static size_t chooseNumBucketsForGroups(size_t numGroups, size_t maxBuckets)
+{
+    size_t res = std::max<size_t>(numGroups, 1021) | 1;
+    while(res < maxBuckets)
+    {
+        bool prime = true;
+        for(size_t d = 3; d * d <= res; d += 2)
+        {
+            if(res % d == 0)
+            {
+                prime = false;
+                break;
+            }
+        }
+        if(prime)
+        {
+            return res;
+        }
+        res += 2;
+    }
+    return maxBuckets;
+}
+
+/**
+ * The memory equi_join may take on this instance for the structures it builds itself: hash tables, bloom and chunk
+ * filters, lookup probes. Intermediate and output MemArrays are not charged; the SciDB cache bounds those by
+ * mem-array-threshold and swaps them out.
+ *
+ * There is one budget per instance, shared by every equi_join of every query running on it; concurrent joins charge
+ * it from their own threads, hence the mutex. With max-memory-limit set, the budget is half of what remains of it
+ * after the MemArray and storage caches; the other half is left to other operators. Without it, the budget is
+ * mem-array-threshold. Structures charge the budget through a MemoryCharge as they grow and release it when they are
+ * freed. A charge past the budget throws, which fails the query rather than the instance; the algorithm choice and
+ * spill sizes are derived from what is available so that this normally doesn't happen.
+ */
+class MemoryBudget : public boost::noncopyable
+{
+private:
+    size_t const       _limit;
+    size_t             _used;
+    mutable std::mutex _mutex;
+
+    MemoryBudget():
+        _limit(computeLimit()),
+        _used(0)
+    {}
+
+public:
+    static MemoryBudget& getInstance()
+    {
+        static MemoryBudget instance;
+        return instance;
+    }
+
+    static size_t computeLimit()
+    {
+        static size_t const MB = 1024 * 1024;
+        static size_t const MIN_BUDGET = 64 * MB;
+        Config* config = Config::getInstance();
+        //mem-array-threshold and smgr-cache-size are SIZE options, held as size_t; max-memory-limit is an INTEGER
+        int64_t const memArrayThreshold = static_cast<int64_t>(config->getOption<size_t>(CONFIG_MEM_ARRAY_THRESHOLD));
+        int64_t const maxMemoryLimit    = config->getOption<int>(CONFIG_MAX_MEMORY_LIMIT);
+        int64_t const smgrCacheSize     = static_cast<int64_t>(config->getOption<size_t>(CONFIG_SMGR_CACHE_SIZE));
+        if(maxMemoryLimit <= 0)
+        {
+            return std::max<size_t>(memArrayThreshold * MB, MIN_BUDGET);
+        }
+        int64_t const remaining = maxMemoryLimit - memArrayThreshold - smgrCacheSize;
+        return std::max<size_t>(remaining > 0 ? remaining / 2 * MB : 0, MIN_BUDGET);
+    }
+
+    size_t getLimit() const
+    {
+        return _limit;
+    }
+
+    size_t getUsed() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _used;
+    }
+
+    size_t getAvailable() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _used < _limit ? _limit - _used : 0;
+    }
+
+    bool tryCharge(size_t const bytes)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(bytes > (_used < _limit ? _limit - _used : 0))
+        {
+            return false;
+        }
+        _used += bytes;
+        return true;
+    }
+
+    void charge(size_t const bytes, char const* what)
+    {
+        if(!tryCharge(bytes))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+                  << "equi_join memory budget of " << _limit / (1024*1024) << " MB exceeded by the " << what
+                  << "; raise max-memory-limit or mem-array-threshold, or use a merge algorithm";
+        }
+    }
+
+    void release(size_t const bytes)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _used -= std::min(bytes, _used);
+    }
+};
+
+/**
+ * What one operator has charged to the instance MemoryBudget, with its high-water marks for the Profile. Charges go
+ * through to the shared budget; this only adds them up, so it is touched by the operator's own thread alone.
+ */
+class MemoryUsage : public boost::noncopyable
+{
+private:
+    MemoryBudget& _budget;
+    size_t        _used;
+    size_t        _peak;
+    size_t        _windowPeak;   //since the last startWindow; see PhaseTimer
+
+public:
+    MemoryUsage(MemoryBudget& budget):
+        _budget(budget),
+        _used(0),
+        _peak(0),
+        _windowPeak(0)
+    {}
+
+    MemoryBudget& getBudget() const
+    {
+        return _budget;
+    }
+
+    size_t getUsed() const
+    {
+        return _used;
+    }
+
+    size_t getPeak() const
+    {
+        return _peak;
+    }
+
+    /**
+     * Start tracking the peak over a new window.
+     * @return the peak of the window being replaced, to be passed back to endWindow when this one ends
+     */
+    size_t startWindow()
+    {
+        size_t const previous = _windowPeak;
+        _windowPeak = _used;
+        return previous;
+    }
+
+    /**
+     * @return the peak over the window, which is then folded into the enclosing one
+     */
+    size_t endWindow(size_t const previous)
+    {
+        size_t const peak = _windowPeak;
+        _windowPeak = std::max(previous, peak);
+        return peak;
+    }
+
+    bool tryCharge(size_t const bytes)
+    {
+        if(!_budget.tryCharge(bytes))
+        {
+            return false;
+        }
+        added(bytes);
+        return true;
+    }
+
+    void charge(size_t const bytes, char const* what)
+    {
+        _budget.charge(bytes, what);
+        added(bytes);
+    }
+
+    void release(size_t const bytes)
+    {
+        size_t const released = std::min(bytes, _used);
+        _budget.release(released);
+        _used -= released;
+    }
+
+private:
+    void added(size_t const bytes)
+    {
+        _used += bytes;
+        _peak = std::max(_peak, _used);
+        _windowPeak = std::max(_windowPeak, _used);
+    }
+};
+
+/**
+ * A charge against the MemoryBudget, on behalf of one operator, that is released when this goes out of scope; resized
+ * as the structure grows.
+ */
+class MemoryCharge : public boost::noncopyable
+{
+private:
+    MemoryUsage&  _usage;
+    char const*   _what;
+    size_t        _bytes;
+
+public:
+    MemoryCharge(MemoryUsage& usage, char const* what, size_t const bytes = 0):
+        _usage(usage),
+        _what(what),
+        _bytes(0)
+    {
+        resize(bytes);
+    }
+
+    ~MemoryCharge()
+    {
+        _usage.release(_bytes);
+    }
+
+    bool tryResize(size_t const bytes)
+    {
+        if(bytes > _bytes)
+        {
+            if(!_usage.tryCharge(bytes - _bytes))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            _usage.release(_bytes - bytes);
+        }
+        _bytes = bytes;
+        return true;
+    }
+
+    void resize(size_t const bytes)
+    {
+        if(bytes > _bytes)
+        {
+            _usage.charge(bytes - _bytes, _what);
+        }
+        else
+        {
+            _usage.release(_bytes - bytes);
+        }
+        _bytes = bytes;
+    }
+};
+
+/**
+ * How the tuples of one or more hash tables spread over their buckets. A chain is the distinct keys of a used bucket,
+ * which a probe compares against in turn; a run is the tuples of one key, which a probe emits. Long chains for the load
+ * factor mean the hash spreads the keys poorly; long runs are the data.
+ */
+class HashTableShape
+{
+public:
+    static size_t const NUM_BINS = 8;   //lengths 1, 2, 3-4, 5-8, ..., 33-64 and 65 or more
+
+private:
+    size_t         _numTables;
+    size_t         _numBuckets;
+    size_t         _usedBuckets;
+    size_t         _numKeys;
+    size_t         _numTuples;
+    size_t         _bytes;
+    size_t         _maxChain;
+    size_t         _maxRun;
+    vector<size_t> _chains;             //number of chains per bin of length
+    vector<size_t> _chainKeys;          //keys in those chains
+    vector<size_t> _runs;
+    vector<size_t> _runTuples;
+
+public:
+    HashTableShape():
+        _numTables(0),
+        _numBuckets(0),
+        _usedBuckets(0),
+        _numKeys(0),
+        _numTuples(0),
+        _bytes(0),
+        _maxChain(0),
+        _maxRun(0),
+        _chains(NUM_BINS, 0),
+        _chainKeys(NUM_BINS, 0),
+        _runs(NUM_BINS, 0),
+        _runTuples(NUM_BINS, 0)
+    {}
+
+    static size_t getBin(size_t length)
+    {
+        size_t bin = 0;
+        while(length > 1 && bin < NUM_BINS - 1)
+        {
+            length = (length + 1) / 2;
+            ++bin;
+        }
+        return bin;
+    }
+
+    /**
+     * @return "1", "2", "3_4", "5_8", ... "65_plus"
+     */
+    static string getBinName(size_t const bin)
+    {
+        if(bin < 2)
+        {
+            return std::to_string(bin + 1);
+        }
+        size_t const lowest = (size_t(1) << (bin - 1)) + 1;
+        if(bin == NUM_BINS - 1)
+        {
+            return std::to_string(lowest) + "_plus";
+        }
+        return std::to_string(lowest) + "_" + std::to_string(size_t(1) << bin);
+    }
+
+    void addTable(size_t const numBuckets, size_t const bytes)
+    {
+        _numTables  += 1;
+        _numBuckets += numBuckets;
+        _bytes      += bytes;
+    }
+
+    void addChain(size_t const keys)
+    {
+        size_t const bin = getBin(keys);
+        _chains[bin]    += 1;
+        _chainKeys[bin] += keys;
+        _usedBuckets    += 1;
+        _numKeys        += keys;
+        _maxChain        = std::max(_maxChain, keys);
+    }
+
+    void addRun(size_t const tuples)
+    {
+        size_t const bin = getBin(tuples);
+        _runs[bin]      += 1;
+        _runTuples[bin] += tuples;
+        _numTuples      += tuples;
+        _maxRun          = std::max(_maxRun, tuples);
+    }
+
+    void add(HashTableShape const& other)
+    {
+        _numTables   += other._numTables;
+        _numBuckets  += other._numBuckets;
+        _usedBuckets += other._usedBuckets;
+        _numKeys     += other._numKeys;
+        _numTuples   += other._numTuples;
+        _bytes       += other._bytes;
+        _maxChain     = std::max(_maxChain, other._maxChain);
+        _maxRun       = std::max(_maxRun,   other._maxRun);
+        for(size_t i=0; i<NUM_BINS; ++i)
+        {
+            _chains[i]    += other._chains[i];
+            _chainKeys[i] += other._chainKeys[i];
+            _runs[i]      += other._runs[i];
+            _runTuples[i] += other._runTuples[i];
+        }
+    }
+
+    size_t getNumTables() const
+    {
+        return _numTables;
+    }
+
+    size_t getNumBuckets() const
+    {
+        return _numBuckets;
+    }
+
+    size_t getUsedBuckets() const
+    {
+        return _usedBuckets;
+    }
+
+    size_t getNumKeys() const
+    {
+        return _numKeys;
+    }
+
+    size_t getNumTuples() const
+    {
+        return _numTuples;
+    }
+
+    size_t getBytes() const
+    {
+        return _bytes;
+    }
+
+    size_t getMaxChain() const
+    {
+        return _maxChain;
+    }
+
+    size_t getMaxRun() const
+    {
+        return _maxRun;
+    }
+
+    size_t getChains(size_t const bin) const
+    {
+        return _chains[bin];
+    }
+
+    size_t getChainKeys(size_t const bin) const
+    {
+        return _chainKeys[bin];
+    }
+
+    size_t getRuns(size_t const bin) const
+    {
+        return _runs[bin];
+    }
+
+    size_t getRunTuples(size_t const bin) const
+    {
+        return _runTuples[bin];
+    }
+
+    double getLoadFactor() const
+    {
+        return _numBuckets == 0 ? 0 : static_cast<double>(_numKeys) / _numBuckets;
+    }
+
+    double getMeanChain() const
+    {
+        return _usedBuckets == 0 ? 0 : static_cast<double>(_numKeys) / _usedBuckets;
+    }
+
+    double getBytesPerTuple() const
+    {
+        return _numTuples == 0 ? 0 : static_cast<double>(_bytes) / _numTuples;
+    }
+
+    /**
+     * With a uniform hash, the keys in a bucket are Poisson with the load factor as mean: a used bucket then holds
+     * lf / (1 - e^-lf) keys on average, 1.58 at a load factor of 1.
+     */
+    double getExpectedMeanChain() const
+    {
+        double const lf = getLoadFactor();
+        return lf <= 0 ? 0 : lf / (1 - std::exp(-lf));
+    }
+
+    /**
+     * @return true if the chains are much longer than a uniform hash would make them, on enough buckets to tell
+     */
+    bool isDegraded() const
+    {
+        static size_t const MIN_USED_BUCKETS = 1024;
+        if(_usedBuckets < MIN_USED_BUCKETS)
+        {
+            return false;
+        }
+        double const expected = getExpectedMeanChain();
+        return getMeanChain() > 2 * expected + 1 || _maxChain > 8 * expected + 16;
+    }
+};
+
+/**
+ * Wall time, CPU time, rows, bytes and memory high-water mark of each phase of the join on this instance, for
+ * profile:true and the debug log. A phase that runs more than once - both sides get tupled, for example - adds up.
+ * The CPU time is that of the thread running the operator; the work SciDB does for a redistribution on other threads
+ * only shows in the wall time.
+ */
+class Profile : public boost::noncopyable
+{
+public:
+    enum Phase
+    {
+        PRESCAN,            //sizing the inputs and picking the algorithm
+        FILTER_EXCHANGE,    //sharing the key sketches and the chunk and bloom filters; bytes are those of the local filters
+        SPLIT,              //agreeing on how the hash space is split between instances, with skew_handling
+        TUPLING,            //tupling an input into a local array before redistributing it
+        SORT,               //sorting tuples, including the tupling of an input that is sorted as it is read
+        REDISTRIBUTE,       //sending tuples or chunks between instances, including the tupling of a streamed input; rows are those received
+        BUILD,              //reading tuples into a hash table, or lookup probes into memory
+        PROBE,              //finding the matches and writing them into output chunks; rows are the matches, before the filter
+        WRITE,              //finishing the output chunks; rows are the output cells
+        NUM_PHASES
+    };
+
+    struct Counters
+    {
+        double wallSeconds;
+        double cpuSeconds;
+        size_t runs;
+        size_t rows;
+        size_t bytes;
+        size_t peakMemory;
+
+        Counters():
+            wallSeconds(0),
+            cpuSeconds(0),
+            runs(0),
+            rows(0),
+            bytes(0),
+            peakMemory(0)
+        {}
+    };
+
+    /**
+     * The filters made from the first array, and what they kept out of the second. Chunks are counted when a chunk
+     * filter was applied, tuples when a bloom filter was.
+     */
+    struct FilterCounters
+    {
+        size_t bloomFilters;
+        size_t bloomBits;
+        size_t bloomBitsSet;
+        size_t scans;           //scans of the second array that applied the filters
+        size_t chunksProbed;
+        size_t chunksExcluded;
+        size_t tuplesProbed;
+        size_t tuplesExcluded;
+        size_t bloomStopped;    //scans that stopped probing the bloom filter as it excluded too few
+
+        FilterCounters():
+            bloomFilters(0),
+            bloomBits(0),
+            bloomBitsSet(0),
+            scans(0),
+            chunksProbed(0),
+            chunksExcluded(0),
+            tuplesProbed(0),
+            tuplesExcluded(0),
+            bloomStopped(0)
+        {}
+    };
+
+private:
+    MemoryUsage&     _memory;
+    vector<Counters> _phases;
+    HashTableShape   _hashTables;
+    FilterCounters   _filters;
+
+public:
+    Profile(MemoryUsage& memory):
+        _memory(memory),
+        _phases(NUM_PHASES)
+    {}
+
+    static char const* getPhaseName(Phase const phase)
+    {
+        switch(phase)
+        {
+        case PRESCAN:         return "prescan";
+        case FILTER_EXCHANGE: return "filter_exchange";
+        case SPLIT:           return "split";
+        case TUPLING:         return "tupling";
+        case SORT:            return "sort";
+        case REDISTRIBUTE:    return "redistribute";
+        case BUILD:           return "build";
+        case PROBE:           return "probe";
+        case WRITE:           return "write";
+        case NUM_PHASES:      break;
+        }
+        return "unknown";
+    }
+
+    MemoryUsage& getMemoryUsage() const
+    {
+        return _memory;
+    }
+
+    Counters const& getCounters(Phase const phase) const
+    {
+        return _phases[phase];
+    }
+
+    void add(Phase const phase, double const wallSeconds, double const cpuSeconds, size_t const rows, size_t const bytes, size_t const peakMemory)
+    {
+        Counters& counters = _phases[phase];
+        counters.wallSeconds += wallSeconds;
+        counters.cpuSeconds  += cpuSeconds;
+        counters.runs        += 1;
+        counters.rows        += rows;
+        counters.bytes       += bytes;
+        counters.peakMemory   = std::max(counters.peakMemory, peakMemory);
+    }
+
+    /**
+     * The shape of the hash tables built on this instance, added up
+     */
+    HashTableShape const& getHashTables() const
+    {
+        return _hashTables;
+    }
+
+    void addHashTable(HashTableShape const& shape)
+    {
+        _hashTables.add(shape);
+    }
+
+    FilterCounters const& getFilters() const
+    {
+        return _filters;
+    }
+
+    void addBloomFilter(size_t const bits, size_t const bitsSet)
+    {
+        _filters.bloomFilters += 1;
+        _filters.bloomBits    += bits;
+        _filters.bloomBitsSet += bitsSet;
+    }
+
+    void addFilterProbes(size_t const chunksProbed, size_t const chunksExcluded, size_t const tuplesProbed, size_t const tuplesExcluded,
+                         bool const bloomStopped)
+    {
+        _filters.scans          += 1;
+        _filters.chunksProbed   += chunksProbed;
+        _filters.chunksExcluded += chunksExcluded;
+        _filters.tuplesProbed   += tuplesProbed;
+        _filters.tuplesExcluded += tuplesExcluded;
+        _filters.bloomStopped   += bloomStopped;
+    }
+
+    void logPhases() const
+    {
+        for(size_t p=0; p<NUM_PHASES; ++p)
+        {
+            Counters const& c = _phases[p];
+            if(c.runs)
+            {
+                LOG4CXX_DEBUG(logger, "EJ profile "<<getPhaseName(static_cast<Phase>(p))<<" runs "<<c.runs<<" wall "<<c.wallSeconds<<" cpu "<<c.cpuSeconds
+                                      <<" rows "<<c.rows<<" bytes "<<c.bytes<<" peak memory "<<c.peakMemory);
+            }
+        }
+        if(_filters.bloomFilters || _filters.chunksProbed || _filters.tuplesProbed)
+        {
+            LOG4CXX_DEBUG(logger, "EJ profile bloom filters "<<_filters.bloomFilters<<" bits "<<_filters.bloomBits<<" set "<<_filters.bloomBitsSet
+                                  <<" tuples probed "<<_filters.tuplesProbed<<" excluded "<<_filters.tuplesExcluded<<" stopped "<<_filters.bloomStopped
+                                  <<" chunks probed "<<_filters.chunksProbed<<" excluded "<<_filters.chunksExcluded);
+        }
+        if(_hashTables.getNumTables())
+        {
+            LOG4CXX_DEBUG(logger, "EJ profile hash tables "<<_hashTables.getNumTables()<<" tuples "<<_hashTables.getNumTuples()
+                                  <<" load factor "<<_hashTables.getLoadFactor()<<" mean chain "<<_hashTables.getMeanChain()
+                                  <<" max chain "<<_hashTables.getMaxChain()<<" max run "<<_hashTables.getMaxRun()
+                                  <<" bytes per tuple "<<_hashTables.getBytesPerTuple());
+        }
+    }
+};
+
+/**
+ * Times one run of a phase from construction to stop() or destruction and adds it to the Profile, along with the
+ * rows and bytes reported and the peak the operator charged to the MemoryBudget meanwhile. Timers may nest.
+ */
+class PhaseTimer : public boost::noncopyable
+{
+private:
+    Profile&                                       _profile;
+    Profile::Phase const                           _phase;
+    std::chrono::steady_clock::time_point const    _wallStart;
+    double const                                   _cpuStart;
+    size_t const                                   _enclosingPeak;
+    size_t                                         _rows;
+    size_t                                         _bytes;
+    bool                                           _running;
+
+    static double threadCpuSeconds()
+    {
+        struct timespec ts;
+        if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        {
+            return 0;
+        }
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+public:
+    PhaseTimer(Profile& profile, Profile::Phase const phase):
+        _profile(profile),
+        _phase(phase),
+        _wallStart(std::chrono::steady_clock::now()),
+        _cpuStart(threadCpuSeconds()),
+        _enclosingPeak(profile.getMemoryUsage().startWindow()),
+        _rows(0),
+        _bytes(0),
+        _running(true)
+    {}
+
+    ~PhaseTimer()
+    {
+        stop();
+    }
+
+    void addRows(size_t const rows)
+    {
+        _rows += rows;
+    }
+
+    void addBytes(size_t const bytes)
+    {
+        _bytes += bytes;
+    }
+
+    void stop()
+    {
+        if(!_running)
+        {
+            return;
+        }
+        _running = false;
+        double const wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - _wallStart).count();
+        double const cpu  = threadCpuSeconds() - _cpuStart;
+        size_t const peak = _profile.getMemoryUsage().endWindow(_enclosingPeak);
+        _profile.add(_phase, wall, cpu, _rows, _bytes, peak);
+    }
+};
+
 //For hash join purposes, the handedness refers to which array is copied into a hash table and redistributed
 enum Handedness
 {
@@ -125,7 +863,13 @@ public:
         HASH_REPLICATE_LEFT,
         HASH_REPLICATE_RIGHT,
         MERGE_LEFT_FIRST,
-        MERGE_RIGHT_FIRST
+        MERGE_RIGHT_FIRST,
+        LATE_LEFT_FIRST,
+        LATE_RIGHT_FIRST,
+        COLOCATED,         //not user-settable: picked only when the inputs are known to be co-located
+        ALIGNED_CHUNKS,    //not user-settable: picked only when the keys are exactly the dimensions, on the same grid
+        LOOKUP_LEFT,
+        LOOKUP_RIGHT
     };
 
 private:
@@ -144,6 +888,8 @@ private:
     vector<size_t>                _leftIds;          //key indeces in the left array:  attributes start at 0, dimensions start at numAttrs
     vector<size_t>                _rightIds;        //key indeces in the right array: attributes start at 0, dimensions start at numAttrs
     vector<bool>                  _keyNullable;      //one per key, in the output
+    shared_ptr<MemoryUsage>       _memoryUsage;
+    shared_ptr<Profile>           _phaseProfile;
     size_t                        _hashJoinThreshold;
     size_t                        _numHashBuckets;
     size_t                        _chunkSize;
@@ -152,6 +898,7 @@ private:
     bool                          _algorithmSet;
     bool                          _keepDimensions;
     size_t                        _bloomFilterSize;
+    bool                          _bloomFilterSizeSet;
     size_t                        _readAheadLimit;
     size_t                        _varSize;
     string                        _filterExpressionString;
@@ -161,6 +908,10 @@ private:
     bool                          _leftOuter;
     bool                          _rightOuter;
     vector<string>                _outNames;
+    bool                          _skewHandling;
+    CompressorType                _shuffleCompression;
+    bool                          _explain;
+    bool                          _profile;
 
     void setParamIds(vector<int64_t> content, vector<size_t> &keys, size_t shift)
     /*
@@ -218,7 +969,7 @@ private:
         {
             throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "hash join threshold must be non negative";
         }
-        _hashJoinThreshold = res * 1024 * 1204;
+        _hashJoinThreshold = res * 1024 * 1024;
         _numHashBuckets = chooseNumBuckets(_hashJoinThreshold / (1024*1024));
     }
 
@@ -258,12 +1009,49 @@ private:
         {
             _algorithm = MERGE_RIGHT_FIRST;
         }
+        else if (trimmedContent == "late_left_first")
+        {
+            _algorithm = LATE_LEFT_FIRST;
+        }
+        else if (trimmedContent == "late_right_first")
+        {
+            _algorithm = LATE_RIGHT_FIRST;
+        }
+        else if (trimmedContent == "lookup_left")
+        {
+            _algorithm = LOOKUP_LEFT;
+        }
+        else if (trimmedContent == "lookup_right")
+        {
+            _algorithm = LOOKUP_RIGHT;
+        }
         else
         {
             throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse algorithm";
         }
     }
 
+    void setParamShuffleCompression(vector <string> content)
+    {
+        string trimmedContent = content[0];
+        if(trimmedContent == "none")
+        {
+            _shuffleCompression = CompressorType::NONE;
+        }
+        else if (trimmedContent == "zlib")
+        {
+            _shuffleCompression = CompressorType::ZLIB;
+        }
+        else if (trimmedContent == "bzlib")
+        {
+            _shuffleCompression = CompressorType::BZLIB;
+        }
+        else
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse shuffle_compression; use none, zlib or bzlib";
+        }
+    }
+
     bool setParamBool(string trimmedContent, bool& value)
     {
         if(trimmedContent == "1" || trimmedContent == "t" || trimmedContent == "T" || trimmedContent == "true" || trimmedContent == "TRUE")
@@ -484,19 +1272,26 @@ public:
         _numLeftDims(_leftSchema.getDimensions().size()),
         _numRightAttrs(_rightSchema.getAttributes(true).size()),
         _numRightDims(_rightSchema.getDimensions().size()),
-        _hashJoinThreshold(Config::getInstance()->getOption<int>(CONFIG_MERGE_SORT_BUFFER) * 1024 * 1024 ),
+        _memoryUsage(new MemoryUsage(MemoryBudget::getInstance())),
+        _phaseProfile(new Profile(*_memoryUsage)),
+        _hashJoinThreshold(std::min<size_t>(Config::getInstance()->getOption<int>(CONFIG_MERGE_SORT_BUFFER) * 1024 * 1024, getMemoryBudget().getLimit() / 2)),
         _numHashBuckets(chooseNumBuckets(_hashJoinThreshold / (1024*1024))),
         _chunkSize(1000000),
         _numInstances(query->getInstancesCount()),
         _algorithm(HASH_REPLICATE_RIGHT),
         _algorithmSet(kwParams.find(KW_ALGORITHM) != kwParams.end()),
         _keepDimensions(false),
-        _bloomFilterSize(33554467), //about 4MB, why not?
+        _bloomFilterSize(33554432), //4MB; a power of 2 so it can be folded down to the number of keys
+        _bloomFilterSizeSet(kwParams.find(KW_BLOOM_FILT_SZ) != kwParams.end()),
         _filterExpressionString(""),
         _filterExpression(NULL),
         _leftOuter(false),
         _rightOuter(false),
-        _outNames(0)
+        _outNames(0),
+        _skewHandling(false),
+        _shuffleCompression(CompressorType::NONE),
+        _explain(false),
+        _profile(false)
     {
         string const outNamesHeader                = "out_names=";
 
@@ -513,6 +1308,10 @@ public:
         setKeywordParamBool(kwParams, KW_RIGHT_OUTER, _rightOuter);
         setKeywordParamJoinField(kwParams, KW_OUT_NAMES, &Settings::setParamOutNames);
         setKeywordParamString(kwParams, KW_FILTER, &Settings::setParamFilterExpression);
+        setKeywordParamBool(kwParams, KW_SKEW_HANDLING, _skewHandling);
+        setKeywordParamString(kwParams, KW_SHUFFLE_COMPRESSION, &Settings::setParamShuffleCompression);
+        setKeywordParamBool(kwParams, KW_EXPLAIN, _explain);
+        setKeywordParamBool(kwParams, KW_PROFILE, _profile);
 
         verifyInputs();
         mapAttributes();
@@ -541,6 +1340,7 @@ private:
         LOG4CXX_DEBUG(logger, "Right names size: " << _rightNames.size());
         throwIf(_leftIds.size() == 0 && _leftNames.size() == 0,   "no left join-on fields provided");
         throwIf(_rightIds.size() == 0 && _rightNames.size() == 0, "no right join-on fields provided");
+        throwIf(_explain && _profile, "explain and profile can't both be set");
         if(_leftNames.size())
         {
             for(size_t i=0; i<_leftNames.size(); ++i)
@@ -653,8 +1453,26 @@ private:
             TypeId rightType  = rightKey < _numRightAttrs ? _rightSchema.getAttributes(true).findattr(rightKey).getType() : TID_INT64;
             throwIf(leftType != rightType, "key types do not match");
         }
-        throwIf( _algorithmSet && _algorithm == HASH_REPLICATE_LEFT  && isLeftOuter(),  "left replicate algorithm cannot be used for left  outer join");
-        throwIf( _algorithmSet && _algorithm == HASH_REPLICATE_RIGHT && isRightOuter(), "right replicate algorithm cannot be used for right outer join");
+        throwIf( _algorithmSet && (_algorithm == LATE_LEFT_FIRST || _algorithm == LATE_RIGHT_FIRST) && (isLeftOuter() || isRightOuter()),
+                 "late materialization algorithms cannot be used for outer joins");
+        throwIf( _algorithmSet && (_algorithm == LOOKUP_LEFT || _algorithm == LOOKUP_RIGHT) && (isLeftOuter() || isRightOuter()),
+                 "lookup algorithms cannot be used for outer joins");
+        throwIf( _algorithmSet && _algorithm == LOOKUP_LEFT  && !dimensionsAreKeys(_rightIds, _numRightAttrs, _numRightDims),
+                 "lookup_left requires all right dimensions to be join keys");
+        throwIf( _algorithmSet && _algorithm == LOOKUP_RIGHT && !dimensionsAreKeys(_leftIds, _numLeftAttrs, _numLeftDims),
+                 "lookup_right requires all left dimensions to be join keys");
+    }
+
+    static bool dimensionsAreKeys(vector<size_t> const& ids, size_t const numAttrs, size_t const numDims)
+    {
+        for(size_t d = 0; d<numDims; ++d)
+        {
+            if(std::find(ids.begin(), ids.end(), numAttrs + d) == ids.end())
+            {
+                return false;
+            }
+        }
+        return true;
     }
 
     void mapAttributes()
@@ -731,7 +1549,7 @@ private:
         Parameter kwParam = getKeywordParam(kwParams, KW_FILTER);
 
         if (kwParam) {
-            ArrayDesc inputDesc = getOutputSchema(query);
+            ArrayDesc inputDesc = getJoinSchema(query);
             vector<ArrayDesc> inputDescs;
             inputDescs.push_back(inputDesc);
             ArrayDesc outputDesc =inputDesc;
@@ -769,6 +1587,12 @@ private:
         output<<" bloom filter size "<<_bloomFilterSize;
         output<<" left outer "<<_leftOuter;
         output<<" right outer "<<_rightOuter;
+        output<<" skew handling "<<_skewHandling;
+        output<<" shuffle compression "<<static_cast<int>(_shuffleCompression);
+        output<<" explain "<<_explain;
+        output<<" profile "<<_profile;
+        output<<" hash join threshold "<<_hashJoinThreshold;
+        output<<" memory budget "<<getMemoryBudget().getLimit()<<" available "<<getMemoryBudget().getAvailable();
         LOG4CXX_DEBUG(logger, "EJ keys "<<output.str().c_str());
     }
 
@@ -895,11 +1719,53 @@ public:
         return _hashJoinThreshold;
     }
 
+    /**
+     * How large a hash table may actually grow before the join gives up on it and merges instead. The threshold is
+     * compared against estimates, so there is some slack, as long as the memory budget has room for it.
+     */
+    size_t getHashTableByteLimit() const
+    {
+        return std::min(2 * _hashJoinThreshold, getMemoryBudget().getAvailable());
+    }
+
+    MemoryBudget& getMemoryBudget() const
+    {
+        return _memoryUsage->getBudget();
+    }
+
+    MemoryUsage& getMemoryUsage() const
+    {
+        return *_memoryUsage;
+    }
+
+    Profile& getProfile() const
+    {
+        return *_phaseProfile;
+    }
+
+    /**
+     * How many bytes a run of equal keys may hold in memory during a merge before it spills.
+     */
+    size_t getRunByteLimit() const
+    {
+        return std::min<size_t>(Config::getInstance()->getOption<int>(CONFIG_MERGE_SORT_BUFFER) * 1024 * 1024, getMemoryBudget().getAvailable() / 4);
+    }
+
     size_t getBloomFilterSize() const
     {
         return _bloomFilterSize;
     }
 
+    bool bloomFilterSizeSet() const
+    {
+        return _bloomFilterSizeSet;
+    }
+
+    CompressorType getShuffleCompression() const
+    {
+        return _shuffleCompression;
+    }
+
     shared_ptr<Expression> const& getFilterExpression() const
     {
         return _filterExpression;
@@ -915,6 +1781,21 @@ public:
         return _rightOuter;
     }
 
+    bool isSkewHandling() const
+    {
+        return _skewHandling;
+    }
+
+    bool isExplain() const
+    {
+        return _explain;
+    }
+
+    bool isProfile() const
+    {
+        return _profile;
+    }
+
     ArrayDesc const& getLeftSchema() const
     {
         return _leftSchema;
@@ -925,7 +1806,59 @@ public:
         return _rightSchema;
     }
 
+    /**
+     * With explain:true, the operator only plans the join and returns what it found as key-value pairs, per instance.
+     */
+    ArrayDesc getExplainSchema(shared_ptr< Query> const& query) const
+    {
+        Attributes outputAttributes;
+        outputAttributes.push_back(AttributeDesc("key",   TID_STRING, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("value", TID_STRING, 0, CompressorType::NONE));
+        outputAttributes.addEmptyTagAttribute();
+        Dimensions outputDimensions;
+        outputDimensions.push_back(DimensionDesc("instance_id", 0, _numInstances-1,            1,          0));
+        outputDimensions.push_back(DimensionDesc("value_no",    0, CoordinateBounds::getMax(), _chunkSize, 0));
+        return ArrayDesc("equi_join_explain", outputAttributes, outputDimensions, createDistribution(dtUndefined), query->getDefaultArrayResidency());
+    }
+
+    /**
+     * With profile:true, the operator runs the join but returns, instead of its result, a row per phase that ran on
+     * each instance; see Profile.
+     */
+    ArrayDesc getProfileSchema(shared_ptr< Query> const& query) const
+    {
+        Attributes outputAttributes;
+        outputAttributes.push_back(AttributeDesc("phase",             TID_STRING, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("runs",              TID_UINT64, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("wall_seconds",      TID_DOUBLE, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("cpu_seconds",       TID_DOUBLE, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("rows",              TID_UINT64, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("bytes",             TID_UINT64, 0, CompressorType::NONE));
+        outputAttributes.push_back(AttributeDesc("peak_memory_bytes", TID_UINT64, 0, CompressorType::NONE));
+        outputAttributes.addEmptyTagAttribute();
+        Dimensions outputDimensions;
+        outputDimensions.push_back(DimensionDesc("instance_id", 0, _numInstances-1,            1,          0));
+        outputDimensions.push_back(DimensionDesc("value_no",    0, CoordinateBounds::getMax(), _chunkSize, 0));
+        return ArrayDesc("equi_join_profile", outputAttributes, outputDimensions, createDistribution(dtUndefined), query->getDefaultArrayResidency());
+    }
+
     ArrayDesc getOutputSchema(shared_ptr< Query> const& query) const
+    {
+        if(_explain)
+        {
+            return getExplainSchema(query);
+        }
+        if(_profile)
+        {
+            return getProfileSchema(query);
+        }
+        return getJoinSchema(query);
+    }
+
+    /**
+     * The schema of the join result, which is also the output unless explain or profile is set.
+     */
+    ArrayDesc getJoinSchema(shared_ptr< Query> const& query) const
     {
         Attributes outputAttributes;
         std::vector<AttributeDesc> tmpOutput(getNumOutputAttrs());
@@ -150,21 +150,27 @@ private:
     size_t                                   _numHashes;
     size_t                                   _numGroups;
     mutable vector<char>                     _hashBuf;
+    vector<bool>                             _matched;          //one per tuple, in insertion order; for outer joins on the table side
+    MemoryCharge                             _charge;
 
 public:
-    JoinHashTable(Settings const& settings, ArenaPtr const& arena, size_t numAttributes):
+    /**
+     * @param numHashBuckets if nonzero, overrides the bucket count picked by the settings; see chooseNumBucketsForGroups
+     */
+    JoinHashTable(Settings const& settings, ArenaPtr const& arena, size_t numAttributes, size_t numHashBuckets = 0):
             _settings(settings),
             _arena(arena),
             _numAttributes(numAttributes),
             _numKeys(_settings.getNumKeys()),
             _keyComparators(_settings.getKeyComparators()),
-            _numHashBuckets(safe_static_cast<uint32_t>(_settings.getNumHashBuckets())),
+            _numHashBuckets(safe_static_cast<uint32_t>(numHashBuckets != 0 ? numHashBuckets : _settings.getNumHashBuckets())),
             _buckets(_arena, _numHashBuckets, NULL),
             _values(0),
             _largeValueMemory(0),
             _numHashes(0),
             _numGroups(0),
-            _hashBuf(64)
+            _hashBuf(64),
+            _charge(settings.getMemoryUsage(), "hash table")
     {}
 
 public:
@@ -183,6 +189,20 @@ public:
         return overhead;
     }
 
+    /**
+     * As above but without the out-of-line bytes of the variable-size attributes, for when those are measured.
+     */
+    static size_t computeFixedTupleOverhead(Attributes const& tupleAttributes)
+    {
+        size_t overhead = sizeof(HashTableEntry);
+        for(size_t i =0; i<tupleAttributes.size(); ++i)
+        {
+            AttributeDesc const& att = tupleAttributes.findattr(i);
+            overhead += (sizeof(Value) + (att.getSize() <= sizeof(void*) ? 0 : att.getSize()));
+        }
+        return overhead;
+    }
+
     template<bool INCLUDE_NULLS = false> //note: the table does not allow null entries but we can hash null values
     static uint32_t hashKeys(vector<Value const*> const& keys, size_t const numKeys, vector<char>& buf)
     {
@@ -314,6 +334,36 @@ private:
     }
 
 public:
+    /**
+     * Store a tuple whose keys are null: it never matches, but is kept and numbered with the others so that an outer
+     * join on the table side emits it with the unmatched tuples.
+     */
+    void insertNullKeys(vector<Value const*> const& tuple)
+    {
+        addTuple(tuple);
+        _matched.push_back(false);
+    }
+
+    size_t getNumTuples() const
+    {
+        return _matched.size();
+    }
+
+    Value const* getTupleByNumber(size_t const tupleNo) const
+    {
+        return getTuple(tupleNo * _numAttributes);
+    }
+
+    bool isMatched(size_t const tupleNo) const
+    {
+        return _matched[tupleNo];
+    }
+
+    void setMatched(size_t const tupleNo)
+    {
+        _matched[tupleNo] = true;
+    }
+
     void insert(vector<Value const*> const& tuple)
     {
         uint32_t hash = hashKeys(tuple, _numKeys) % _numHashBuckets;
@@ -339,6 +389,7 @@ public:
         _numGroups += newGroup;
         _numHashes += newHash;
         size_t idx = addTuple(tuple);
+        _matched.push_back(false);
         HashTableEntry* newEntry = ((HashTableEntry*)_arena->allocate(sizeof(HashTableEntry)));
         *newEntry = HashTableEntry(idx,*entry);
         *entry = newEntry;
@@ -372,7 +423,57 @@ public:
         {
             throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)<<"inconsistent state size overflow";
         }
-        return _arena->allocated() + _values.size() * sizeof(Value)  + _largeValueMemory;
+        return _arena->allocated() + _values.size() * sizeof(Value)  + _largeValueMemory + _matched.size() / 8;
+    }
+
+    /**
+     * Bring the charge against the memory budget up to usedBytes().
+     * @return false if the budget doesn't have room; the charge is then unchanged
+     */
+    bool tryChargeBudget()
+    {
+        return _charge.tryResize(usedBytes());
+    }
+
+    /**
+     * As above, but throws if the budget doesn't have room.
+     */
+    void chargeBudget()
+    {
+        _charge.resize(usedBytes());
+    }
+
+    /**
+     * Walk all the buckets to measure their chains and runs; see HashTableShape. Tuples with null keys are not in the
+     * buckets and are left out.
+     */
+    HashTableShape getShape() const
+    {
+        HashTableShape shape;
+        shape.addTable(_numHashBuckets, usedBytes());
+        for(uint32_t b=0; b<_numHashBuckets; ++b)
+        {
+            HashTableEntry const* entry = _buckets[b];
+            if(entry == NULL)
+            {
+                continue;
+            }
+            size_t keys = 0;
+            while(entry != NULL)
+            {
+                Value const* groupTuple = getTuple(entry->idx);
+                size_t run = 0;
+                while(entry != NULL && keysEqual(getTuple(entry->idx), groupTuple))
+                {
+                    ++run;
+                    entry = entry->next;
+                }
+                shape.addRun(run);
+                ++keys;
+            }
+            shape.addChain(keys);
+        }
+        return shape;
     }
 
     class const_iterator
@@ -460,6 +561,18 @@ public:
             return &(_table->_values[_entry->idx]);
         }
 
+        /**
+         * @return the insertion order of the current tuple; see setMatched
+         */
+        size_t getTupleNumber() const
+        {
+            if (end())
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "access past end";
+            }
+            return _entry->idx / _table->_numAttributes;
+        }
+
         bool find(vector<Value const*> const& keys)
         {
             _currHash = _table->hashKeys(keys, _table->_numKeys) % _table->_numHashBuckets;
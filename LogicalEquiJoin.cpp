@@ -122,6 +122,10 @@ public:
             { KW_FILTER, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
             { KW_LEFT_OUTER, RE(PP(PLACEHOLDER_EXPRESSION, TID_BOOL)) },
             { KW_RIGHT_OUTER, RE(PP(PLACEHOLDER_EXPRESSION, TID_BOOL)) },
+            { KW_SKEW_HANDLING, RE(PP(PLACEHOLDER_EXPRESSION, TID_BOOL)) },
+            { KW_SHUFFLE_COMPRESSION, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
+            { KW_EXPLAIN, RE(PP(PLACEHOLDER_EXPRESSION, TID_BOOL)) },
+            { KW_PROFILE, RE(PP(PLACEHOLDER_EXPRESSION, TID_BOOL)) },
             { KW_OUT_NAMES, RE(RE::OR, {
                                RE(PP(PLACEHOLDER_ATTRIBUTE_NAME).setMustExist(false)),
                                RE(RE::GROUP, {
@@ -39,6 +39,9 @@ using namespace equi_join;
 
 class PhysicalEquiJoin : public PhysicalOperator
 {
+private:
+    ArrayDesc _joinSchema; //what the join writes; with profile:true, _schema is that of the report instead
+
 public:
     PhysicalEquiJoin(string const& logicalName,
                              string const& physicalName,
@@ -73,10 +76,156 @@ public:
         return context.getArrayDistribution()->getDistType();
     }
 
+    /**
+     * Measured out-of-line bytes per cell, over all the variable-size attributes, with a confidence interval of about
+     * 95% around the mean.
+     */
+    struct WidthSample
+    {
+        double mean;
+        double low;
+        double high;
+        WidthSample():
+            mean(0),
+            low(0),
+            high(0)
+        {}
+    };
+
+    /**
+     * Measure the variable-size attributes of the input in up to SAMPLE_CHUNKS chunks. For a materialized input they
+     * are picked uniformly at random from all its chunk positions on this instance, which only reads chunk headers.
+     * Any other input would be computed in full by that walk, so its first SAMPLE_CHUNKS chunks are taken instead:
+     * those are the ones the pre-scan reads first anyway. A value takes sizeof(Value) in a table plus its size when it
+     * doesn't fit inline; only the latter is measured. The interval comes from the spread of the per-chunk averages.
+     */
+    WidthSample sampleVarSizeWidth(shared_ptr<Array>& input, shared_ptr<Query> const& query, bool const materialized)
+    {
+        static size_t const SAMPLE_CHUNKS = 16;
+        WidthSample result;
+        ArrayDesc const& desc = input->getArrayDesc();
+        vector<shared_ptr<ConstArrayIterator> > varIters;
+        for(const auto& attr : desc.getAttributes(true))
+        {
+            if(attr.getSize() == 0)
+            {
+                varIters.push_back(input->getConstIterator(attr));
+            }
+        }
+        if(varIters.empty())
+        {
+            return result;
+        }
+        uint64_t rngState = 0x9E3779B97F4A7C15ULL ^ query->getInstanceID();
+        vector<Coordinates> positions;
+        size_t numChunks = 0;
+        shared_ptr<ConstArrayIterator> aiter = input->getConstIterator(*desc.getEmptyBitmapAttribute());
+        while(!aiter->end() && (materialized || numChunks < SAMPLE_CHUNKS))
+        {
+            ++numChunks;
+            if(positions.size() < SAMPLE_CHUNKS)
+            {
+                positions.push_back(aiter->getPosition());
+            }
+            else
+            {
+                rngState ^= rngState << 13;
+                rngState ^= rngState >> 7;
+                rngState ^= rngState << 17;
+                size_t const slot = rngState % numChunks;
+                if(slot < SAMPLE_CHUNKS)
+                {
+                    positions[slot] = aiter->getPosition();
+                }
+            }
+            ++(*aiter);
+        }
+        bool const allChunks = aiter->end();
+        vector<double> chunkMeans;
+        double totalBytes = 0;
+        double totalCells = 0;
+        for(size_t i=0; i<positions.size(); ++i)
+        {
+            double chunkBytes = 0;
+            double chunkCells = 0;
+            for(size_t j=0; j<varIters.size(); ++j)
+            {
+                if(!varIters[j]->setPosition(positions[i]))
+                {
+                    throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+                }
+                shared_ptr<ConstChunkIterator> citer = varIters[j]->getChunk().getConstIterator();
+                while(!citer->end())
+                {
+                    Value const& v = citer->getItem();
+                    if(!v.isNull() && v.size() > sizeof(void*))
+                    {
+                        chunkBytes += v.size();
+                    }
+                    if(j == 0)
+                    {
+                        chunkCells += 1;
+                    }
+                    ++(*citer);
+                }
+            }
+            if(chunkCells > 0)
+            {
+                chunkMeans.push_back(chunkBytes / chunkCells);
+                totalBytes += chunkBytes;
+                totalCells += chunkCells;
+            }
+        }
+        if(totalCells == 0)
+        {
+            return result;
+        }
+        result.mean = totalBytes / totalCells;
+        double stdErr = 0;
+        size_t const k = chunkMeans.size();
+        if(k > 1 && (k < numChunks || !allChunks))
+        {
+            double var = 0;
+            for(size_t i=0; i<k; ++i)
+            {
+                var += (chunkMeans[i] - result.mean) * (chunkMeans[i] - result.mean);
+            }
+            var /= (k - 1);
+            //the finite population correction needs the number of chunks, only known when they were all walked
+            double const fpc = allChunks ? 1.0 - static_cast<double>(k) / numChunks : 1.0;
+            stdErr = std::sqrt(var / k * fpc);
+        }
+        else if (k == 1 && (numChunks > 1 || !allChunks))
+        {
+            stdErr = result.mean; //one chunk of many says little
+        }
+        result.low  = std::max(0.0, result.mean - 2 * stdErr);
+        result.high = result.mean + 2 * stdErr;
+        LOG4CXX_DEBUG(logger, "EJ sampled "<<k<<" of "<<numChunks<<(allChunks ? "" : "+")<<" chunks, var-size bytes per cell "<<result.mean
+                              <<" ["<<result.low<<", "<<result.high<<"]");
+        return result;
+    }
+
+    /**
+     * Upper bound on the bytes per cell once tupled, from the measured variable-size attributes.
+     */
+    template<Handedness WHICH>
+    size_t sampleCellSize(shared_ptr<Array> &input, shared_ptr<Query> const& query, Settings const& settings)
+    {
+        WidthSample const sample = sampleVarSizeWidth(input, query, input->isMaterialized());
+        return JoinHashTable::computeFixedTupleOverhead(makeTupledSchema<WHICH> (settings, query).getAttributes(true)) +
+               static_cast<size_t>(std::ceil(sample.high));
+    }
+
     template<Handedness WHICH>
     size_t computeArrayOverhead(shared_ptr<Array> &input, shared_ptr<Query>& query, Settings const& settings)
     {
-        size_t tupleOverhead = JoinHashTable::computeTupleOverhead(makeTupledSchema<WHICH> (settings, query).getAttributes(true));
+        size_t tupleOverhead = sampleCellSize<WHICH>(input, query, settings);
+        return countCells(input) * tupleOverhead;
+    }
+
+    size_t countCells(shared_ptr<Array> &input)
+    {
         size_t totalCount = 0;
         const auto &ebmAttr = input->getArrayDesc().getEmptyBitmapAttribute();
         shared_ptr<ConstArrayIterator> aiter(input->getConstIterator(*ebmAttr));
@@ -85,34 +234,17 @@ public:
             totalCount += aiter->getChunk().count();
             ++(*aiter);
         }
-        return totalCount * tupleOverhead;
+        return totalCount;
     }
 
-    template<Handedness WHICH>
-    size_t globalComputeArrayOverhead(shared_ptr<Array> &input, shared_ptr<Query>& query, Settings const& settings)
+    /**
+     * Record the local cells of an array made by a phase, and about how much memory they'd take as tuples.
+     */
+    void profileResult(PhaseTimer& timer, shared_ptr<Array>& result)
     {
-        size_t overhead =  computeArrayOverhead<WHICH>(input, query, settings);
-        size_t const nInstances = query->getInstancesCount();
-        InstanceID myId = query->getInstanceID();
-        std::shared_ptr<SharedBuffer> buf(new MemoryBuffer(SCIDB_CODE_LOC, NULL, sizeof(size_t)));
-        *((size_t*) buf->getWriteData()) = overhead;
-        for(InstanceID i=0; i<nInstances; i++)
-        {
-           if(i != myId)
-           {
-               BufSend(i, buf, query);
-           }
-        }
-        for(InstanceID i=0; i<nInstances; i++)
-        {
-           if(i != myId)
-           {
-               buf = BufReceive(i,query);
-               size_t otherInstanceSize = *((size_t*) buf->getWriteData());
-               overhead += otherInstanceSize;
-           }
-        }
-        return overhead;
+        size_t const cells = countCells(result);
+        timer.addRows(cells);
+        timer.addBytes(cells * JoinHashTable::computeTupleOverhead(result->getArrayDesc().getAttributes(true)));
     }
 
     /**
@@ -143,101 +275,215 @@ public:
         return value;
     }
 
+    /**
+     * What one instance found out about the inputs for the planning: whether each is materialized here, and the
+     * cells counted with their size once tupled.
+     */
     struct PreScanResult
     {
+        bool materializedLeft;
+        bool materializedRight;
         bool finishedLeft;
         bool finishedRight;
-        size_t leftSizeEstimate;
+        size_t leftCells;
+        size_t rightCells;
+        size_t leftSizeEstimate;   //upper bounds, using the upper bound of the measured cell size
         size_t rightSizeEstimate;
+        size_t leftSizeLow;        //lower bounds
+        size_t rightSizeLow;
         PreScanResult():
+            materializedLeft(false),
+            materializedRight(false),
             finishedLeft(false),
             finishedRight(false),
+            leftCells(0),
+            rightCells(0),
             leftSizeEstimate(0),
-            rightSizeEstimate(0)
+            rightSizeEstimate(0),
+            leftSizeLow(0),
+            rightSizeLow(0)
         {}
     };
 
-    PreScanResult localPreScan(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> const& query, Settings const& settings)
+    /**
+     * Gather what the planning needs from this instance in one local pass. A materialized array is counted to the
+     * end, which only reads chunk headers. The others are scanned until either array reaches hash_join_threshold, and
+     * at least as far as the other one. A stream has to be copied before it can be scanned; that's skipped when the
+     * other array is materialized and its part here is under an equal share of hash_join_threshold, as that one is
+     * then likely to be replicated. Without copyStreams (explain), a stream is never copied, and so not scanned.
+     */
+    PreScanResult localPreScan(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> const& query, Settings const& settings,
+                               bool const copyStreams)
     {
         LOG4CXX_DEBUG(logger, "EJ starting local prescan");
-        if(inputArrays[0]->getSupportedAccess() == Array::SINGLE_PASS)
+        PreScanResult result;
+        result.materializedLeft  = inputArrays[0]->isMaterialized();
+        result.materializedRight = inputArrays[1]->isMaterialized();
+        size_t const threshold = settings.getHashJoinThreshold();
+        size_t const leftFixedSize  = JoinHashTable::computeFixedTupleOverhead(makeTupledSchema<LEFT> (settings, query).getAttributes(true));
+        size_t const rightFixedSize = JoinHashTable::computeFixedTupleOverhead(makeTupledSchema<RIGHT>(settings, query).getAttributes(true));
+        WidthSample leftSample, rightSample;
+        size_t leftCellSize  = leftFixedSize;
+        size_t rightCellSize = rightFixedSize;
+        if(result.materializedLeft)
         {
-            LOG4CXX_DEBUG(logger, "EJ ensuring left random access");
-            inputArrays[0] = ensureRandomAccess(inputArrays[0], query);
+            leftSample   = sampleVarSizeWidth(inputArrays[0], query, true);
+            leftCellSize = leftFixedSize + static_cast<size_t>(std::ceil(leftSample.high));
+            result.leftCells    = countCells(inputArrays[0]);
+            result.finishedLeft = true;
         }
-        if(inputArrays[1]->getSupportedAccess() == Array::SINGLE_PASS)
+        if(result.materializedRight)
         {
-            LOG4CXX_DEBUG(logger, "EJ ensuring right random access");
-            inputArrays[1] = ensureRandomAccess(inputArrays[1], query); //TODO: well, after this nasty thing we can know the exact size
+            rightSample   = sampleVarSizeWidth(inputArrays[1], query, true);
+            rightCellSize = rightFixedSize + static_cast<size_t>(std::ceil(rightSample.high));
+            result.rightCells    = countCells(inputArrays[1]);
+            result.finishedRight = true;
         }
-        ArrayDesc const& leftDesc  = inputArrays[0]->getArrayDesc();
-        ArrayDesc const& rightDesc = inputArrays[1]->getArrayDesc();
-        size_t leftCellSize  = JoinHashTable::computeTupleOverhead(makeTupledSchema<LEFT> (settings, query).getAttributes(true));
-        size_t rightCellSize = JoinHashTable::computeTupleOverhead(makeTupledSchema<LEFT> (settings, query).getAttributes(true));
-        const auto &leftEbmAttr = leftDesc.getEmptyBitmapAttribute();
-        shared_ptr<ConstArrayIterator> laiter = inputArrays[0]->getConstIterator(*leftEbmAttr);
-        const auto &rightEbmAttr = rightDesc.getEmptyBitmapAttribute();
-        shared_ptr<ConstArrayIterator> raiter = inputArrays[1]->getConstIterator(*rightEbmAttr);
-        size_t leftSize =0, rightSize =0;
-        size_t const threshold = settings.getHashJoinThreshold();
-        while(leftSize < threshold && rightSize < threshold && !laiter->end() && !raiter->end())
+        size_t const thresholdShare = threshold / query->getInstancesCount();
+        bool scanLeft  = !result.materializedLeft;
+        bool scanRight = !result.materializedRight;
+        if(scanLeft && inputArrays[0]->getSupportedAccess() == Array::SINGLE_PASS)
+        {
+            if(!copyStreams || (result.materializedRight && result.rightCells * rightCellSize < thresholdShare))
+            {
+                scanLeft = false;
+            }
+            else
+            {
+                LOG4CXX_DEBUG(logger, "EJ ensuring left random access");
+                inputArrays[0] = ensureRandomAccess(inputArrays[0], query);
+            }
+        }
+        if(scanRight && inputArrays[1]->getSupportedAccess() == Array::SINGLE_PASS)
+        {
+            if(!copyStreams || (result.materializedLeft && result.leftCells * leftCellSize < thresholdShare))
+            {
+                scanRight = false;
+            }
+            else
+            {
+                LOG4CXX_DEBUG(logger, "EJ ensuring right random access");
+                inputArrays[1] = ensureRandomAccess(inputArrays[1], query); //TODO: well, after this nasty thing we can know the exact size
+            }
+        }
+        shared_ptr<ConstArrayIterator> laiter, raiter;
+        if(scanLeft)
+        {
+            leftSample   = sampleVarSizeWidth(inputArrays[0], query, false);
+            leftCellSize = leftFixedSize + static_cast<size_t>(std::ceil(leftSample.high));
+            laiter = inputArrays[0]->getConstIterator(*inputArrays[0]->getArrayDesc().getEmptyBitmapAttribute());
+        }
+        if(scanRight)
+        {
+            rightSample   = sampleVarSizeWidth(inputArrays[1], query, false);
+            rightCellSize = rightFixedSize + static_cast<size_t>(std::ceil(rightSample.high));
+            raiter = inputArrays[1]->getConstIterator(*inputArrays[1]->getArrayDesc().getEmptyBitmapAttribute());
+        }
+        size_t leftSize  = result.leftCells  * leftCellSize;
+        size_t rightSize = result.rightCells * rightCellSize;
+        while(scanLeft && scanRight && leftSize < threshold && rightSize < threshold && !laiter->end() && !raiter->end())
         {
             leftSize  += laiter->getChunk().count() * leftCellSize;
             rightSize += raiter->getChunk().count() * rightCellSize;
             ++(*laiter);
             ++(*raiter);
         }
-        if(laiter->end()) //make sure we've scanned at least the same size from both (in case the chunks are differently sized)
+        //make sure we've scanned at least the same size from both (in case the chunks are differently sized, or the other was counted)
+        if(scanRight && (!scanLeft || laiter->end()))
         {
-            while(!raiter->end() && rightSize<leftSize)
+            while(!raiter->end() && rightSize < std::min(leftSize, threshold))
             {
                 rightSize += raiter->getChunk().count() * rightCellSize;
                 ++(*raiter);
             }
         }
-        else if(raiter->end())
+        else if(scanLeft && (!scanRight || raiter->end()))
         {
-            while(!laiter->end() && leftSize<rightSize)
+            while(!laiter->end() && leftSize < std::min(rightSize, threshold))
             {
                 leftSize += laiter->getChunk().count() * leftCellSize;
                 ++(*laiter);
             }
         }
-        PreScanResult result;
-        if(laiter->end())
+        if(scanLeft)
         {
-            result.finishedLeft=true;
+            result.finishedLeft = laiter->end();
+            result.leftCells    = leftSize / leftCellSize;
         }
-        if(raiter->end())
+        if(scanRight)
         {
-            result.finishedRight=true;
+            result.finishedRight = raiter->end();
+            result.rightCells    = rightSize / rightCellSize;
         }
-        result.leftSizeEstimate =leftSize;
-        result.rightSizeEstimate=rightSize;
+        result.leftSizeEstimate  = leftSize;
+        result.rightSizeEstimate = rightSize;
+        result.leftSizeLow  = static_cast<size_t>(result.leftCells  * (leftFixedSize  + leftSample.low));
+        result.rightSizeLow = static_cast<size_t>(result.rightCells * (rightFixedSize + rightSample.low));
         LOG4CXX_DEBUG(logger, "EJ prescan complete left cell overhead "<<leftCellSize<<" right cell overhead "<<rightCellSize
+                              <<" leftMaterialized "<<result.materializedLeft<<" rightMaterialized "<<result.materializedRight
                               <<" leftFinished "<<result.finishedLeft<<" rightFinished "<< result.finishedRight
-                              <<" leftSize "<<result.leftSizeEstimate<<" rightSize "<<result.rightSizeEstimate);
+                              <<" leftSize "<<result.leftSizeLow<<"-"<<result.leftSizeEstimate<<" rightSize "<<result.rightSizeLow<<"-"<<result.rightSizeEstimate);
         return result;
     }
 
-    void globalPreScan(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings,
-                       size_t& leftFinished, size_t& rightFinished, size_t& leftSizeEst, size_t& rightSizeEst)
+    /**
+     * What the planning found out about the inputs, added up over the instances; also reported by explain:true. Sizes
+     * are in bytes once tupled; for arrays that are not materialized they are exact only if the pre-scan finished
+     * everywhere.
+     */
+    struct PlanInfo
     {
-        leftFinished = 0;
-        rightFinished = 0;
-        leftSizeEst = 0;
-        rightSizeEst = 0;
-        PreScanResult localResult = localPreScan(inputArrays, query, settings);
-        if(localResult.finishedLeft)
-        {
-            leftFinished++;
-        }
-        if(localResult.finishedRight)
+        bool   sized;
+        bool   leftMaterialized;  //on every instance
+        bool   rightMaterialized;
+        size_t leftFinished;      //number of instances where the left array was fully counted
+        size_t rightFinished;
+        size_t leftCells;
+        size_t rightCells;
+        size_t leftSize;          //upper bounds
+        size_t rightSize;
+        size_t leftSizeLow;
+        size_t rightSizeLow;
+        PlanInfo():
+            sized(false),
+            leftMaterialized(false),
+            rightMaterialized(false),
+            leftFinished(0),
+            rightFinished(0),
+            leftCells(0),
+            rightCells(0),
+            leftSize(0),
+            rightSize(0),
+            leftSizeLow(0),
+            rightSizeLow(0)
+        {}
+
+        void add(PreScanResult const& result)
         {
-            rightFinished++;
+            leftMaterialized  = leftMaterialized  && result.materializedLeft;
+            rightMaterialized = rightMaterialized && result.materializedRight;
+            leftFinished  += result.finishedLeft  ? 1 : 0;
+            rightFinished += result.finishedRight ? 1 : 0;
+            leftCells    += result.leftCells;
+            rightCells   += result.rightCells;
+            leftSize     += result.leftSizeEstimate;
+            rightSize    += result.rightSizeEstimate;
+            leftSizeLow  += result.leftSizeLow;
+            rightSizeLow += result.rightSizeLow;
         }
-        leftSizeEst+=localResult.leftSizeEstimate;
-        rightSizeEst+=localResult.rightSizeEstimate;
+    };
+
+    /**
+     * Pre-scan locally and exchange the results in a single round: every instance then holds the same PlanInfo and
+     * plans the same way from it, with no further messages.
+     */
+    void globalPreScan(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings, PlanInfo& plan,
+                       bool const copyStreams = true)
+    {
+        PreScanResult const localResult = localPreScan(inputArrays, query, settings, copyStreams);
+        plan = PlanInfo();
+        plan.leftMaterialized = plan.rightMaterialized = true;
+        plan.add(localResult);
         shared_ptr<SharedBuffer> buf(new MemoryBuffer(SCIDB_CODE_LOC, NULL, sizeof(PreScanResult)));
         InstanceID myId = query->getInstanceID();
         *((PreScanResult*) buf->getWriteData()) = localResult;
@@ -253,77 +499,344 @@ public:
             if(i != myId)
             {
                 buf = BufReceive(i,query);
-                PreScanResult otherInstanceResult = *((PreScanResult*) buf->getWriteData());
-                if(otherInstanceResult.finishedLeft)
-                {
-                    leftFinished++;
-                }
-                if(otherInstanceResult.finishedRight)
-                {
-                    rightFinished++;
-                }
-                leftSizeEst+=otherInstanceResult.leftSizeEstimate;
-                rightSizeEst+=otherInstanceResult.rightSizeEstimate;
+                plan.add(*((PreScanResult*) buf->getWriteData()));
+            }
+        }
+        plan.sized = true;
+        LOG4CXX_DEBUG(logger, "EJ global prescan complete leftMaterialized "<<plan.leftMaterialized<<" rightMaterialized "<<plan.rightMaterialized
+                              <<" leftFinished "<<plan.leftFinished<<" rightFinished "<<plan.rightFinished
+                              <<" leftCells "<<plan.leftCells<<" rightCells "<<plan.rightCells
+                              <<" leftOverhead "<<plan.leftSizeLow<<"-"<<plan.leftSize<<" rightOverhead "<<plan.rightSizeLow<<"-"<<plan.rightSize);
+    }
+
+    /**
+     * Sketch the keys of the first maxTuples tuples of the input on this instance.
+     */
+    template<Handedness WHICH>
+    void sampleKeys(shared_ptr<Array>& input, Settings const& settings, HyperLogLog& sketch, size_t const maxTuples)
+    {
+        TuplingReader<WHICH, false, false> reader(input, settings, NULL, NULL, NULL, NULL, NULL, &sketch);
+        for(size_t i = 0; i < maxTuples && !reader.end(); ++i)
+        {
+            reader.next();
+        }
+    }
+
+    /**
+     * Whether to redistribute locators instead of whole tuples. Only for inner joins, and only when the non-key
+     * payload of both tuples is much wider than a locator, which is judged from the schemas before anything is read.
+     * Then the keys of a sample of both inputs are sketched, and the cost of each algorithm for the sample is
+     * compared, in bytes: Merge sends every tuple; late materialization sends every locator, plus a request and a
+     * left tuple for every output cell, and reads both tuples of every output cell back from the local stores.
+     * Without copyStreams (explain), a stream input can't be sampled, and the answer is no.
+     */
+    bool preferLateMaterialization(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings,
+                                   bool const copyStreams)
+    {
+        static size_t const LATE_WIDTH_RATIO  = 8;
+        static size_t const SAMPLE_TUPLES     = 65536;
+        static size_t const STORE_READ_WEIGHT = 4;   //a byte read back from a local store costs this much less than a byte sent
+        if(settings.isLeftOuter() || settings.isRightOuter())
+        {
+            return false;
+        }
+        ArrayDesc const leftSchema  = makeTupledSchema<LEFT> (settings, query);
+        ArrayDesc const rightSchema = makeTupledSchema<RIGHT>(settings, query);
+        Attributes keyAttributes;
+        for(size_t i=0; i<settings.getNumKeys(); ++i)
+        {
+            keyAttributes.push_back(leftSchema.getAttributes(true).findattr(i));
+        }
+        size_t const keyWidth      = JoinHashTable::computeTupleOverhead(keyAttributes);
+        size_t const leftWidth     = JoinHashTable::computeTupleOverhead(leftSchema.getAttributes(true));
+        size_t const rightWidth    = JoinHashTable::computeTupleOverhead(rightSchema.getAttributes(true));
+        size_t const locatorWidth  = JoinHashTable::computeTupleOverhead(makeLocatorSchema<LEFT>(settings, query).getAttributes(true));
+        size_t const leftPayload   = leftWidth  - keyWidth;
+        size_t const rightPayload  = rightWidth - keyWidth;
+        LOG4CXX_DEBUG(logger, "EJ tuple widths left "<<leftWidth<<" right "<<rightWidth<<" keys "<<keyWidth<<" locator "<<locatorWidth);
+        if(leftPayload < LATE_WIDTH_RATIO * locatorWidth || rightPayload < LATE_WIDTH_RATIO * locatorWidth)
+        {
+            return false;
+        }
+        //every instance has to take part in the exchanges below, so they all have to agree to skip them
+        bool const streams = inputArrays[0]->getSupportedAccess() == Array::SINGLE_PASS || inputArrays[1]->getSupportedAccess() == Array::SINGLE_PASS;
+        if(!copyStreams && !agreeOnBoolean(!streams, query))
+        {
+            return false;
+        }
+        for(size_t i=0; i<2; ++i)
+        {
+            if(inputArrays[i]->getSupportedAccess() == Array::SINGLE_PASS)
+            {
+                inputArrays[i] = ensureRandomAccess(inputArrays[i], query);
+            }
+        }
+        HyperLogLog leftSketch;
+        HyperLogLog rightSketch;
+        sampleKeys<LEFT> (inputArrays[0], settings, leftSketch,  SAMPLE_TUPLES);
+        sampleKeys<RIGHT>(inputArrays[1], settings, rightSketch, SAMPLE_TUPLES);
+        leftSketch.globalExchange(query);
+        rightSketch.globalExchange(query);
+        size_t const requestWidth = JoinHashTable::computeTupleOverhead(makeFetchRequestSchema(settings, query).getAttributes(true));
+        size_t const fetchedWidth = JoinHashTable::computeTupleOverhead(makeFetchedSchema(settings, query).getAttributes(true));
+        double const fetchCost    = requestWidth + fetchedWidth + static_cast<double>(leftWidth + rightWidth) / STORE_READ_WEIGHT;
+        double const outputCells  = static_cast<double>(estimateOutputSize(leftSketch, rightSketch));
+        double const mergeBytes   = static_cast<double>(leftSketch.getCount()) * leftWidth + static_cast<double>(rightSketch.getCount()) * rightWidth;
+        double const lateBytes    = static_cast<double>(leftSketch.getCount() + rightSketch.getCount()) * locatorWidth + outputCells * fetchCost;
+        LOG4CXX_DEBUG(logger, "EJ key sample left count "<<leftSketch.getCount()<<" distinct "<<leftSketch.estimate()
+                              <<" right count "<<rightSketch.getCount()<<" distinct "<<rightSketch.estimate()
+                              <<" output "<<outputCells<<" fetch cost "<<fetchCost<<" merge bytes "<<mergeBytes<<" late bytes "<<lateBytes);
+        return lateBytes < mergeBytes;
+    }
+
+    /**
+     * Whether matching cells are always in chunks at the same position: both arrays are joined on all of their
+     * dimensions, dimension d of one with dimension d of the other, and those have the same chunk grid. There may
+     * be more keys.
+     */
+    bool dimensionsAligned(vector< shared_ptr< Array> >& inputArrays, Settings const& settings)
+    {
+        ArrayDesc const& leftDesc  = inputArrays[0]->getArrayDesc();
+        ArrayDesc const& rightDesc = inputArrays[1]->getArrayDesc();
+        size_t const numDims = settings.getNumLeftDims();
+        if(numDims != settings.getNumRightDims() || numDims > settings.getNumKeys())
+        {
+            return false;
+        }
+        for(size_t d=0; d<numDims; ++d)
+        {
+            ssize_t const leftKey  = settings.mapLeftToTuple (settings.getNumLeftAttrs()  + d);
+            ssize_t const rightKey = settings.mapRightToTuple(settings.getNumRightAttrs() + d);
+            DimensionDesc const& leftDim  = leftDesc.getDimensions()[d];
+            DimensionDesc const& rightDim = rightDesc.getDimensions()[d];
+            if( leftKey != rightKey || leftKey >= static_cast<ssize_t>(settings.getNumKeys()) ||
+                leftDim.getStartMin() != rightDim.getStartMin() || leftDim.getChunkInterval() != rightDim.getChunkInterval())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Whether every pair of matching cells is already on the same instance: the dimensions are aligned and both
+     * arrays are spread over the instances by chunk position in the same way.
+     */
+    bool inputsColocated(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings)
+    {
+        ArrayDesc const& leftDesc  = inputArrays[0]->getArrayDesc();
+        ArrayDesc const& rightDesc = inputArrays[1]->getArrayDesc();
+        ArrayDistPtr const& leftDist  = leftDesc.getDistribution();
+        ArrayDistPtr const& rightDist = rightDesc.getDistribution();
+        DistType const distType = leftDist->getDistType();
+        if( query->getInstancesCount() == 1 ||
+            (distType != dtHashPartitioned && distType != dtRowCyclic && distType != dtColCyclic) ||
+            leftDist->getRedundancy() != 0 || rightDist->getRedundancy() != 0 ||
+            !leftDist->checkCompatibility(rightDist) ||
+            !leftDesc.getResidency()->isEqual(rightDesc.getResidency()) ||
+            !leftDesc.getResidency()->isEqual(query->getDefaultArrayResidency()))
+        {
+            return false;
+        }
+        return dimensionsAligned(inputArrays, settings);
+    }
+
+    /**
+     * Whether every dimension of the WHICH array is a join key, so that the keys of a tuple from the other side
+     * name a single cell of it.
+     */
+    template<Handedness WHICH>
+    bool dimensionsAreKeys(Settings const& settings)
+    {
+        size_t const numAttrs = (WHICH == LEFT ? settings.getNumLeftAttrs() : settings.getNumRightAttrs());
+        size_t const numDims  = (WHICH == LEFT ? settings.getNumLeftDims()  : settings.getNumRightDims());
+        for(size_t d=0; d<numDims; ++d)
+        {
+            ssize_t const key = (WHICH == LEFT ? settings.mapLeftToTuple(numAttrs + d) : settings.mapRightToTuple(numAttrs + d));
+            if(key < 0 || key >= static_cast<ssize_t>(settings.getNumKeys()))
+            {
+                return false;
             }
         }
+        return true;
+    }
+
+    /**
+     * Whether to look the replicated SMALL side up in the other array by position instead of scanning the other
+     * array: only for inner joins where the other array is stored, keyed on all of its dimensions, and has many
+     * more cells than there are probes.
+     */
+    template<Handedness WHICH_SMALL>
+    bool preferLookup(PlanInfo const& plan, Settings const& settings)
+    {
+        static size_t const LOOKUP_CELL_RATIO = 64;
+        Handedness const WHICH_BIG = (WHICH_SMALL == LEFT ? RIGHT : LEFT);
+        bool const bigMaterialized = (WHICH_SMALL == LEFT ? plan.rightMaterialized : plan.leftMaterialized);
+        if(settings.isLeftOuter() || settings.isRightOuter() || !dimensionsAreKeys<WHICH_BIG>(settings) || !bigMaterialized)
+        {
+            return false;
+        }
+        size_t const smallCells = (WHICH_SMALL == LEFT ? plan.leftCells  : plan.rightCells);
+        size_t const bigCells   = (WHICH_SMALL == LEFT ? plan.rightCells : plan.leftCells);
+        LOG4CXX_DEBUG(logger, "EJ lookup candidate probes "<<smallCells<<" cells "<<bigCells);
+        return smallCells * LOOKUP_CELL_RATIO <= bigCells;
     }
 
-    Settings::algorithm pickAlgorithm(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings)
+    /**
+     * With copyStreams false, as for explain, an input that can only be read once is never copied: the pre-scan
+     * leaves it out and late materialization isn't sampled, so the pick can differ from the one execute would make.
+     */
+    Settings::algorithm pickAlgorithm(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings,
+                                      PlanInfo& plan, bool const copyStreams = true)
     {
         if(settings.algorithmSet()) //user override
         {
             return settings.getAlgorithm();
         }
+        //aligned chunks joined in place send nothing; if they'd have to be redistributed first, whole and unfiltered,
+        //replicating a small side is cheaper, so that is only tried once neither side fits
+        bool const aligned = dimensionsAligned(inputArrays, settings) && settings.getNumKeys() == settings.getNumLeftDims();
+        if(inputsColocated(inputArrays, query, settings))
+        {
+            return aligned ? Settings::ALIGNED_CHUNKS : Settings::COLOCATED;
+        }
         size_t const nInstances = query->getInstancesCount();
         size_t const hashJoinThreshold = settings.getHashJoinThreshold();
-        bool leftMaterialized = agreeOnBoolean(inputArrays[0]->isMaterialized(), query);
-        size_t leftOverhead  = leftMaterialized ? globalComputeArrayOverhead<LEFT>(inputArrays[0], query, settings) : -1;
-        LOG4CXX_DEBUG(logger, "EJ left materialized "<<leftMaterialized<< " overhead "<<leftOverhead);
-        if(leftMaterialized && leftOverhead < hashJoinThreshold && settings.isLeftOuter() == false)
+        globalPreScan(inputArrays, query, settings, plan, copyStreams);
+        if(plan.leftMaterialized && plan.leftSize < hashJoinThreshold)
         {
-            return Settings::HASH_REPLICATE_LEFT;
+            return preferLookup<LEFT>(plan, settings) ? Settings::LOOKUP_LEFT : Settings::HASH_REPLICATE_LEFT;
         }
-        bool rightMaterialized = agreeOnBoolean(inputArrays[1]->isMaterialized(), query);
-        size_t rightOverhead = rightMaterialized ? globalComputeArrayOverhead<RIGHT>(inputArrays[1], query, settings) : -1;
-        LOG4CXX_DEBUG(logger, "EJ right materialized "<<rightMaterialized<< " overhead "<<rightOverhead);
-        if(rightMaterialized && rightOverhead < hashJoinThreshold && settings.isRightOuter() == false)
+        if(plan.rightMaterialized && plan.rightSize < hashJoinThreshold)
         {
-            return Settings::HASH_REPLICATE_RIGHT;
+            return preferLookup<RIGHT>(plan, settings) ? Settings::LOOKUP_RIGHT : Settings::HASH_REPLICATE_RIGHT;
+        }
+        if(aligned && plan.leftMaterialized && plan.rightMaterialized)
+        {
+            return Settings::ALIGNED_CHUNKS;
         }
-        if(leftMaterialized && rightMaterialized)
+        bool const late = preferLateMaterialization(inputArrays, query, settings, copyStreams);
+        if(plan.leftMaterialized && plan.rightMaterialized)
         {
-            return leftOverhead < rightOverhead ? Settings::MERGE_LEFT_FIRST : Settings::MERGE_RIGHT_FIRST;
+            if(late)
+            {
+                return plan.leftSize < plan.rightSize ? Settings::LATE_LEFT_FIRST : Settings::LATE_RIGHT_FIRST;
+            }
+            return plan.leftSize < plan.rightSize ? Settings::MERGE_LEFT_FIRST : Settings::MERGE_RIGHT_FIRST;
         }
-        size_t leftArraysFinished =0;
-        size_t rightArraysFinished=0;
-        size_t leftOverheadEst = 0;
-        size_t rightOverheadEst =0;
-        globalPreScan(inputArrays, query, settings, leftArraysFinished, rightArraysFinished, leftOverheadEst, rightOverheadEst);
-        LOG4CXX_DEBUG(logger, "EJ global prescan complete leftFinished "<<leftArraysFinished<<" rightFinished "<< rightArraysFinished<<" leftOverhead "<<leftOverheadEst<<
-                      " rightOverhead "<<rightOverheadEst);
-        if(leftArraysFinished == nInstances && leftOverheadEst < hashJoinThreshold && settings.isLeftOuter() == false)
+        //replicate only if the upper bound fits
+        if(plan.leftFinished == nInstances && plan.leftSize < hashJoinThreshold)
         {
             return Settings::HASH_REPLICATE_LEFT;
         }
-        if(rightArraysFinished == nInstances && rightOverheadEst < hashJoinThreshold && settings.isRightOuter() == false)
+        if(plan.rightFinished == nInstances && plan.rightSize < hashJoinThreshold)
         {
             return Settings::HASH_REPLICATE_RIGHT;
         }
-        //~~~ I dunno, Richard Parker, what do you think? Try to start with the thing that was smaller on most instances
-        return leftArraysFinished < rightArraysFinished ? Settings::MERGE_RIGHT_FIRST : Settings::MERGE_LEFT_FIRST;
+        if(aligned)
+        {
+            return Settings::ALIGNED_CHUNKS;
+        }
+        //if both arrays were scanned completely and one is smaller for sure, start with it
+        bool leftFirst = plan.leftFinished >= plan.rightFinished;
+        if(plan.leftFinished == nInstances && plan.rightFinished == nInstances && plan.leftSize < plan.rightSizeLow)
+        {
+            leftFirst = true;
+        }
+        else if(plan.leftFinished == nInstances && plan.rightFinished == nInstances && plan.rightSize < plan.leftSizeLow)
+        {
+            leftFirst = false;
+        }
+        //~~~ I dunno, Richard Parker, what do you think? Otherwise try to start with the thing that was smaller on most instances
+        if(late)
+        {
+            return leftFirst ? Settings::LATE_LEFT_FIRST : Settings::LATE_RIGHT_FIRST;
+        }
+        return leftFirst ? Settings::MERGE_LEFT_FIRST : Settings::MERGE_RIGHT_FIRST;
+    }
+
+    /**
+     * Whether the WHICH array is known to be small enough that its replicated hash table won't outgrow the memory
+     * budget: counted to the end on every instance, and at most 1/SMALL_ARRAY_RATIO of hash_join_threshold. The
+     * table is then built without the exchange that lets the instances give up on it together.
+     */
+    template<Handedness WHICH>
+    bool isSmallArray(PlanInfo const& plan, shared_ptr<Query>& query, Settings const& settings)
+    {
+        static size_t const SMALL_ARRAY_RATIO = 16;
+        size_t const finished = (WHICH == LEFT ? plan.leftFinished : plan.rightFinished);
+        size_t const size     = (WHICH == LEFT ? plan.leftSize     : plan.rightSize);
+        return plan.sized && finished == query->getInstancesCount() && size * SMALL_ARRAY_RATIO <= settings.getHashJoinThreshold();
+    }
+
+    /**
+     * Charge the memory budget for a table being built. With no byteLimit, the table can't be given up on, so running
+     * out of budget throws.
+     * @return false if the table should be given up on
+     */
+    bool chargeHashTable(JoinHashTable& table, size_t const byteLimit)
+    {
+        if(byteLimit == std::numeric_limits<size_t>::max())
+        {
+            table.chargeBudget();
+            return true;
+        }
+        return table.usedBytes() <= byteLimit && table.tryChargeBudget();
+    }
+
+    /**
+     * Measure a table that was built in full for the profile, and warn if its chains are much longer than its load
+     * factor calls for: every probe walks them.
+     */
+    void recordHashTableShape(JoinHashTable const& table, Settings const& settings)
+    {
+        HashTableShape const shape = table.getShape();
+        LOG4CXX_DEBUG(logger, "EJ hash table buckets "<<shape.getNumBuckets()<<" used "<<shape.getUsedBuckets()<<" keys "<<shape.getNumKeys()
+                              <<" tuples "<<shape.getNumTuples()<<" mean chain "<<shape.getMeanChain()<<" max chain "<<shape.getMaxChain()
+                              <<" max run "<<shape.getMaxRun()<<" bytes per tuple "<<shape.getBytesPerTuple());
+        if(shape.isDegraded())
+        {
+            LOG4CXX_WARN(logger, "EJ hash table chains are long for a load factor of "<<shape.getLoadFactor()<<": mean "<<shape.getMeanChain()
+                                 <<" where "<<shape.getExpectedMeanChain()<<" is expected, max "<<shape.getMaxChain()
+                                 <<"; probes will be slow, the join keys hash poorly into "<<shape.getNumBuckets()<<" buckets");
+        }
+        settings.getProfile().addHashTable(shape);
     }
 
-    template <Handedness WHICH, ReadArrayType ARRAY_TYPE>
-    void readIntoHashTable(shared_ptr<Array> & array, JoinHashTable& table, Settings const& settings, ChunkFilter<WHICH>* chunkFilterToPopulate = NULL)
+    /**
+     * TABLE_OUTER_JOIN means the join is outer on the side of the table: tuples with null keys are then kept in the
+     * table too, to be emitted as unmatched by arrayToTableJoin.
+     * @return false if the table grew past byteLimit and reading was stopped; the table is then incomplete
+     */
+    template <Handedness WHICH, ReadArrayType ARRAY_TYPE, bool TABLE_OUTER_JOIN = false>
+    bool readIntoHashTable(shared_ptr<Array> & array, JoinHashTable& table, Settings const& settings, ChunkFilter<WHICH>* chunkFilterToPopulate = NULL,
+                           size_t const byteLimit = std::numeric_limits<size_t>::max())
     {
-        if ((WHICH == LEFT && settings.isLeftOuter()) || (WHICH == RIGHT && settings.isRightOuter()))
+        static size_t const CHECK_INTERVAL = 1024;
+        if (!TABLE_OUTER_JOIN && ((WHICH == LEFT && settings.isLeftOuter()) || (WHICH == RIGHT && settings.isRightOuter())))
         {
             throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)<<"internal inconsistency";
         }
-        ArrayReader<WHICH, ARRAY_TYPE> reader(array, settings);
+        PhaseTimer timer(settings.getProfile(), Profile::BUILD);
+        ArrayReader<WHICH, ARRAY_TYPE, TABLE_OUTER_JOIN> reader(array, settings);
+        size_t const numKeys = settings.getNumKeys();
+        size_t numRead = 0;
         while(!reader.end())
         {
+            if(++numRead % CHECK_INTERVAL == 0 && !chargeHashTable(table, byteLimit))
+            {
+                LOG4CXX_DEBUG(logger, "EJ hash table reached "<<table.usedBytes()<<" bytes after "<<numRead<<" tuples, limit "<<byteLimit);
+                timer.addRows(numRead);
+                timer.addBytes(table.usedBytes());
+                return false;
+            }
             vector<Value const*> const& tuple = reader.getTuple();
+            if(TABLE_OUTER_JOIN && isNullTuple(tuple, numKeys))
+            {
+                table.insertNullKeys(tuple);
+                reader.next();
+                continue;
+            }
             if(chunkFilterToPopulate)
             {
                 chunkFilterToPopulate->addTuple(tuple);
@@ -332,17 +845,74 @@ public:
             reader.next();
         }
         reader.logStats();
+        timer.addRows(table.getNumTuples());
+        timer.addBytes(table.usedBytes());
+        if(!chargeHashTable(table, byteLimit))
+        {
+            return false;
+        }
+        recordHashTableShape(table, settings);
+        return true;
+    }
+
+    /**
+     * OR the matched bits of a replicated table across instances. Tuple t is emitted, if unmatched, by instance
+     * t % nInstances, so each instance only needs the bits of its own tuples from the others.
+     */
+    void globalMergeMatched(JoinHashTable& table, shared_ptr<Query>& query)
+    {
+        size_t const nInstances = query->getInstancesCount();
+        InstanceID const myId = query->getInstanceID();
+        size_t const numTuples = table.getNumTuples();
+        for(InstanceID i=0; i<nInstances; i++)
+        {
+            if(i == myId)
+            {
+                continue;
+            }
+            size_t const numOwned = i < numTuples ? (numTuples - i + nInstances - 1) / nInstances : 0;
+            std::shared_ptr<SharedBuffer> buf(new MemoryBuffer(SCIDB_CODE_LOC, NULL, numOwned / 8 + 1));
+            uint8_t* bits = (uint8_t*) buf->getWriteData();
+            memset(bits, 0, numOwned / 8 + 1);
+            for(size_t k=0; k<numOwned; ++k)
+            {
+                if(table.isMatched(i + k * nInstances))
+                {
+                    bits[k / 8] |= (1 << (k % 8));
+                }
+            }
+            BufSend(i, buf, query);
+        }
+        size_t const numMine = myId < numTuples ? (numTuples - myId + nInstances - 1) / nInstances : 0;
+        for(InstanceID i=0; i<nInstances; i++)
+        {
+            if(i == myId)
+            {
+                continue;
+            }
+            std::shared_ptr<SharedBuffer> buf = BufReceive(i, query);
+            uint8_t const* bits = (uint8_t const*) buf->getWriteData();
+            for(size_t k=0; k<numMine; ++k)
+            {
+                if(bits[k / 8] & (1 << (k % 8)))
+                {
+                    table.setMatched(myId + k * nInstances);
+                }
+            }
+        }
     }
 
-    template <Handedness WHICH_IS_IN_TABLE, ReadArrayType ARRAY_TYPE, bool ARRAY_OUTER_JOIN>
+    template <Handedness WHICH_IS_IN_TABLE, ReadArrayType ARRAY_TYPE, bool ARRAY_OUTER_JOIN, bool TABLE_OUTER_JOIN = false>
     shared_ptr<Array> arrayToTableJoin(shared_ptr<Array>& array, JoinHashTable& table, shared_ptr<Query>& query,
-                                       Settings const& settings, ChunkFilter<WHICH_IS_IN_TABLE> const* chunkFilter = NULL)
+                                       Settings const& settings, ChunkFilter<WHICH_IS_IN_TABLE> const* chunkFilter = NULL,
+                                       bool const tableReplicated = false)
     {
         //handedness LEFT means the LEFT array is in table so this reads in reverse
-        //ARRAY_OUTER_JOIN means the join is outer on the side of the array. The table doesn't support outer joins, so if we were outer
-        //on the other side, we wouldn't be in this loop.
+        //ARRAY_OUTER_JOIN means the join is outer on the side of the array.
+        //TABLE_OUTER_JOIN means the join is outer on the side of the table: the tuples that are matched are marked, and the
+        //rest are emitted at the end. If the table is replicated, the marks are combined across instances first.
         ArrayReader<WHICH_IS_IN_TABLE == LEFT ? RIGHT : LEFT, ARRAY_TYPE, ARRAY_OUTER_JOIN> reader(array, settings, chunkFilter, NULL);
-        ArrayWriter<WRITE_OUTPUT> result(settings, query, _schema);
+        ArrayWriter<WRITE_OUTPUT> result(settings, query, _joinSchema);
         JoinHashTable::const_iterator iter = table.getIterator();
         size_t const numKeys = settings.getNumKeys();
         while(!reader.end())
@@ -364,7 +934,11 @@ public:
                 while(!iter.end() && iter.atKeys(tuple))
                 {
                     Value const* tablePiece = iter.getTuple();
-                    if(WHICH_IS_IN_TABLE == LEFT)
+                    if(TABLE_OUTER_JOIN)
+                    {
+                        table.setMatched(iter.getTupleNumber());
+                    }
+                    if(WHICH_IS_IN_TABLE == LEFT)
                     {
                         result.writeTuple(tablePiece, tuple);
                     }
@@ -378,62 +952,183 @@ public:
             reader.next();
         }
         reader.logStats();
+        if(TABLE_OUTER_JOIN)
+        {
+            if(tableReplicated)
+            {
+                globalMergeMatched(table, query);
+            }
+            size_t const step  = tableReplicated ? query->getInstancesCount() : 1;
+            size_t const first = tableReplicated ? query->getInstanceID() : 0;
+            size_t unmatched = 0;
+            for(size_t t = first; t < table.getNumTuples(); t += step)
+            {
+                if(!table.isMatched(t))
+                {
+                    result.writeOuterTuple<WHICH_IS_IN_TABLE>(table.getTupleByNumber(t));
+                    ++unmatched;
+                }
+            }
+            LOG4CXX_DEBUG(logger, "EJ table tuples "<<table.getNumTuples()<<" unmatched here "<<unmatched);
+        }
         return result.finalize();
     }
 
+    /**
+     * Copy the whole array to every instance.
+     */
+    shared_ptr<Array> replicate(shared_ptr<Array>& input, shared_ptr<Query>& query, Settings const& settings)
+    {
+        PhaseTimer timer(settings.getProfile(), Profile::REDISTRIBUTE);
+        shared_ptr<Array> result = redistributeToRandomAccess(input, createDistribution(dtReplication), ArrayResPtr(), query, shared_from_this());
+        profileResult(timer, result);
+        return result;
+    }
+
     template <Handedness WHICH_REPLICATED>
-    shared_ptr<Array> replicationHashJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings)
+    shared_ptr<Array> replicationHashJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings,
+                                          bool const small = false)
     {
-        if((WHICH_REPLICATED == LEFT && settings.isLeftOuter()) || (WHICH_REPLICATED == RIGHT && settings.isRightOuter()))
+        bool const tableOuter = (WHICH_REPLICATED == LEFT ? settings.isLeftOuter()  : settings.isRightOuter());
+        bool const arrayOuter = (WHICH_REPLICATED == LEFT ? settings.isRightOuter() : settings.isLeftOuter());
+        shared_ptr<Array>& array    = (WHICH_REPLICATED == LEFT ? inputArrays[1]: inputArrays[0]);
+        shared_ptr<Array>& original = (WHICH_REPLICATED == LEFT ? inputArrays[0] : inputArrays[1]);
+        //unless the user forced this algorithm or the array is known to be small, be ready to give up on it if the table
+        //turns out too large. The merge then takes this array from the replicated copy, which every instance has in
+        //full, except when it sorts before the SG or handles skew: those read the local part again
+        bool const mayGiveUp = !settings.algorithmSet() && !small;
+        bool const reReadOriginal = settings.getHashJoinThreshold() == 0 || (settings.isSkewHandling() && query->getInstancesCount() > 1);
+        size_t const byteLimit = mayGiveUp ? settings.getHashTableByteLimit() : std::numeric_limits<size_t>::max();
+        if(mayGiveUp && reReadOriginal && original->getSupportedAccess() == Array::SINGLE_PASS)
         {
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+            original = ensureRandomAccess(original, query);
         }
-        shared_ptr<Array> redistributed = (WHICH_REPLICATED == LEFT ? inputArrays[0] : inputArrays[1]);
-        redistributed = redistributeToRandomAccess(redistributed, createDistribution(dtReplication), ArrayResPtr(), query, shared_from_this());
-        ArenaPtr operatorArena = this->getArena();
-        ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::replicationHashJoin()").resetting(true).threading(false).pagesize(8 * 1024 * 1204).parent(operatorArena)));
-        JoinHashTable table(settings, hashArena, WHICH_REPLICATED == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize());
-        shared_ptr<ChunkFilter<WHICH_REPLICATED> >filter;
-        if ((WHICH_REPLICATED == LEFT && !settings.isRightOuter()) || (WHICH_REPLICATED == RIGHT && !settings.isLeftOuter()))
+        shared_ptr<Array> redistributed = replicate(original, query, settings);
         {
-            filter.reset(new ChunkFilter<WHICH_REPLICATED>(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()));
+            ArenaPtr operatorArena = this->getArena();
+            ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::replicationHashJoin()").resetting(true).threading(false).pagesize(8 * 1024 * 1024).parent(operatorArena)));
+            JoinHashTable table(settings, hashArena, WHICH_REPLICATED == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize());
+            shared_ptr<ChunkFilter<WHICH_REPLICATED> >filter;
+            if ((WHICH_REPLICATED == LEFT && !settings.isRightOuter()) || (WHICH_REPLICATED == RIGHT && !settings.isLeftOuter()))
+            {
+                filter.reset(new ChunkFilter<WHICH_REPLICATED>(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()));
+            }
+            MemoryCharge filterCharge(settings.getMemoryUsage(), "chunk filter", filter.get() ? filter->getByteSize() : 0);
+            bool const fits = tableOuter ? readIntoHashTable<WHICH_REPLICATED, READ_INPUT, true> (redistributed, table, settings, filter.get(), byteLimit) :
+                                           readIntoHashTable<WHICH_REPLICATED, READ_INPUT>       (redistributed, table, settings, filter.get(), byteLimit);
+            if(!mayGiveUp || agreeOnBoolean(fits, query))
+            {
+                if(tableOuter)
+                {
+                    return arrayOuter ? arrayToTableJoin<WHICH_REPLICATED, READ_INPUT, true,  true>(array, table, query, settings, filter.get(), true) :
+                                        arrayToTableJoin<WHICH_REPLICATED, READ_INPUT, false, true>(array, table, query, settings, filter.get(), true);
+                }
+                if(arrayOuter)
+                {
+                    return arrayToTableJoin<WHICH_REPLICATED, READ_INPUT, true>(array, table, query, settings, filter.get());
+                }
+                return arrayToTableJoin<WHICH_REPLICATED, READ_INPUT, false>(array, table, query, settings, filter.get());
+            }
         }
-        readIntoHashTable<WHICH_REPLICATED, READ_INPUT> (redistributed, table, settings, filter.get());
-        if(settings.isLeftOuter() || settings.isRightOuter())
+        LOG4CXX_DEBUG(logger, "EJ replicated table exceeded "<<byteLimit<<" bytes, switching to merge");
+        if(reReadOriginal)
         {
-            return arrayToTableJoin<WHICH_REPLICATED, READ_INPUT, true>( WHICH_REPLICATED == LEFT ? inputArrays[1]: inputArrays[0], table, query, settings, filter.get());
+            redistributed.reset();
+            return mergeJoin<WHICH_REPLICATED>(inputArrays, query, settings);
         }
-        return arrayToTableJoin<WHICH_REPLICATED, READ_INPUT, false>( WHICH_REPLICATED == LEFT ? inputArrays[1]: inputArrays[0], table, query, settings, filter.get());
+        return mergeJoin<WHICH_REPLICATED>(inputArrays, query, settings, redistributed);
     }
 
+    /**
+     * Tuple the input into a local array, meant to be partitioned later with redistributeTupled; the hashes can be
+     * sampled into partitioningToSample on the way.
+     */
     template <Handedness WHICH, bool INCLUDE_NULL_TUPLES = false, bool HASH_NULLS = false>
-    shared_ptr<Array> readIntoPreSort(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings,
-                                      ChunkFilter<WHICH>* chunkFilterToGenerate, ChunkFilter<WHICH == LEFT ? RIGHT : LEFT> const* chunkFilterToApply,
-                                      BloomFilter* bloomFilterToGenerate,        BloomFilter const* bloomFilterToApply)
+    shared_ptr<Array> readIntoPreSg(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings,
+                                    ChunkFilter<WHICH>* chunkFilterToGenerate, ChunkFilter<WHICH == LEFT ? RIGHT : LEFT> const* chunkFilterToApply,
+                                    BloomFilter* bloomFilterToGenerate,        BloomFilter const* bloomFilterToApply,
+                                    HashPartitioning* partitioningToSample = NULL, HyperLogLog* sketchToGenerate = NULL)
     {
-        ArrayReader<WHICH, READ_INPUT, INCLUDE_NULL_TUPLES> reader(inputArray, settings, chunkFilterToApply, bloomFilterToApply);
+        TuplingReader<WHICH, INCLUDE_NULL_TUPLES, HASH_NULLS> reader(inputArray, settings, chunkFilterToGenerate, chunkFilterToApply,
+                                                                     bloomFilterToGenerate, bloomFilterToApply, partitioningToSample, sketchToGenerate);
+        PhaseTimer timer(settings.getProfile(), Profile::TUPLING);
         ArrayWriter<WRITE_TUPLED> writer(settings, query, makeTupledSchema<WHICH>(settings, query));
-        uint32_t const hashMod = safe_static_cast<uint32_t>(settings.getNumHashBuckets());
-        vector<char> hashBuf(64);
+        while(!reader.end())
+        {
+            writer.writeTuple(reader.getTuple());
+            reader.next();
+        }
+        reader.logStats();
+        shared_ptr<Array> result = writer.finalize();
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * Tuple the input and redistribute it by hash in one pass: the redistribution pulls partitioned chunks from a
+     * TupledArrayStream as they fill up, so sending overlaps with reading and nothing is materialized before the SG.
+     */
+    template <Handedness WHICH, bool INCLUDE_NULL_TUPLES = false, bool HASH_NULLS = false>
+    shared_ptr<Array> tupleAndRedistribute(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings,
+                                           ChunkFilter<WHICH>* chunkFilterToGenerate, ChunkFilter<WHICH == LEFT ? RIGHT : LEFT> const* chunkFilterToApply,
+                                           BloomFilter* bloomFilterToGenerate,        BloomFilter const* bloomFilterToApply,
+                                           HyperLogLog* sketchToGenerate = NULL)
+    {
+        PhaseTimer timer(settings.getProfile(), Profile::REDISTRIBUTE);
+        typedef TuplingReader<WHICH, INCLUDE_NULL_TUPLES, HASH_NULLS> Reader;
+        Reader reader(inputArray, settings, chunkFilterToGenerate, chunkFilterToApply, bloomFilterToGenerate, bloomFilterToApply, NULL, sketchToGenerate);
+        HashPartitioning evenPartitioning(settings, query, false);
+        shared_ptr<Array> stream(new TupledArrayStream<Reader>(makeTupledSchema<WHICH>(settings, query), reader, query, settings, &evenPartitioning));
+        shared_ptr<Array> result = redistributeToRandomAccess(stream, createDistribution(dtByRow), query->getDefaultArrayResidency(), query, shared_from_this());
+        reader.logStats();
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * When the whole array is already on every instance, keep the tuples that tupleAndRedistribute would have sent
+     * to this one, and send nothing. The filters and the sketch are made from the kept tuples only, so that once
+     * exchanged they count every tuple once, as after tupleAndRedistribute.
+     */
+    template <Handedness WHICH, bool INCLUDE_NULL_TUPLES = false, bool HASH_NULLS = false>
+    shared_ptr<Array> tupleOwnPartition(shared_ptr<Array> const& replicated, shared_ptr<Query>& query, Settings const& settings,
+                                        ChunkFilter<WHICH>* chunkFilterToGenerate, BloomFilter* bloomFilterToGenerate, HyperLogLog* sketchToGenerate)
+    {
+        PhaseTimer timer(settings.getProfile(), Profile::TUPLING);
+        shared_ptr<Array> input = replicated;
+        TuplingReader<WHICH, INCLUDE_NULL_TUPLES, HASH_NULLS> reader(input, settings, NULL, NULL, NULL, NULL);
+        HashPartitioning evenPartitioning(settings, query, false);
+        vector<uint32_t> const& breaks = evenPartitioning.getHashBreaks();
+        size_t const myPartition = query->getInstanceID();
         size_t const numKeys = settings.getNumKeys();
-        Value hashVal;
+        vector<char> hashBuf(64);
+        ArrayWriter<WRITE_TUPLED> writer(settings, query, makeTupledSchema<WHICH>(settings, query));
         while(!reader.end())
         {
             vector<Value const*> const& tuple = reader.getTuple();
-            if(chunkFilterToGenerate)
-            {
-                chunkFilterToGenerate->addTuple(tuple);
-            }
-            if(bloomFilterToGenerate)
+            uint32_t const hash = tuple[tuple.size()-1]->getUint32();
+            if(static_cast<size_t>(std::lower_bound(breaks.begin(), breaks.end(), hash) - breaks.begin()) == myPartition)
             {
-                bloomFilterToGenerate->addTuple(tuple, numKeys);
+                if(chunkFilterToGenerate)
+                {
+                    chunkFilterToGenerate->addTuple(tuple);
+                }
+                if(bloomFilterToGenerate)
+                {
+                    bloomFilterToGenerate->addTuple(tuple, numKeys);
+                }
+                if(sketchToGenerate)
+                {
+                    sketchToGenerate->addHash(JoinHashTable::hashKeys<HASH_NULLS>(tuple, numKeys, hashBuf));
+                }
+                writer.writeTuple(tuple);
             }
-            hashVal.setUint32( JoinHashTable::hashKeys<HASH_NULLS>(tuple, numKeys, hashBuf) % hashMod);
-            writer.writeTupleWithHash(tuple, hashVal);
             reader.next();
         }
         reader.logStats();
-        return writer.finalize();
+        shared_ptr<Array> result = writer.finalize();
+        profileResult(timer, result);
+        return result;
     }
 
     shared_ptr<Array> sortArray(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings)
@@ -447,37 +1142,215 @@ public:
             sortingAttributeInfos[k+1].columnNo = k;
             sortingAttributeInfos[k+1].ascent = true;
         }
+        PhaseTimer timer(settings.getProfile(), Profile::SORT);
         SortArray sorter(inputArray->getArrayDesc(), _arena);
         sorter.setChunkSize(settings.getChunkSize());
         shared_ptr<TupleComparator> tcomp(std::make_shared<TupleComparator>(sortingAttributeInfos, inputArray->getArrayDesc()));
-        return sorter.getSortedArray(inputArray, query, shared_from_this(), tcomp);
+        shared_ptr<Array> result = sorter.getSortedArray(inputArray, query, shared_from_this(), tcomp);
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * For late materialization: sort a local state array on one int64 position attribute, so that a TupleFetcher
+     * walks its store in value_no order and opens each chunk once.
+     */
+    shared_ptr<Array> sortByPosition(shared_ptr<Array> & inputArray, size_t const posColumn, shared_ptr<Query>& query, Settings const& settings)
+    {
+        SortingAttributeInfos sortingAttributeInfos(1);
+        sortingAttributeInfos[0].columnNo = safe_static_cast<int>(posColumn);
+        sortingAttributeInfos[0].ascent = true;
+        PhaseTimer timer(settings.getProfile(), Profile::SORT);
+        SortArray sorter(inputArray->getArrayDesc(), _arena);
+        sorter.setChunkSize(settings.getChunkSize());
+        shared_ptr<TupleComparator> tcomp(std::make_shared<TupleComparator>(sortingAttributeInfos, inputArray->getArrayDesc()));
+        shared_ptr<Array> result = sorter.getSortedArray(inputArray, query, shared_from_this(), tcomp);
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * Tuple the input and sort it on (hash, keys); the sort pulls its input from a TupledArrayStream, so the only
+     * array made here is the sorted one.
+     */
+    template <Handedness WHICH, bool INCLUDE_NULL_TUPLES = false, bool HASH_NULLS = false>
+    shared_ptr<Array> tupleAndSort(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings,
+                                   ChunkFilter<WHICH>* chunkFilterToGenerate, ChunkFilter<WHICH == LEFT ? RIGHT : LEFT> const* chunkFilterToApply,
+                                   BloomFilter* bloomFilterToGenerate,        BloomFilter const* bloomFilterToApply,
+                                   HashPartitioning* partitioningToSample = NULL, HyperLogLog* sketchToGenerate = NULL)
+    {
+        typedef TuplingReader<WHICH, INCLUDE_NULL_TUPLES, HASH_NULLS> Reader;
+        Reader reader(inputArray, settings, chunkFilterToGenerate, chunkFilterToApply, bloomFilterToGenerate, bloomFilterToApply, partitioningToSample, sketchToGenerate);
+        shared_ptr<Array> stream(new TupledArrayStream<Reader>(makeTupledSchema<WHICH>(settings, query), reader, query, settings, NULL));
+        shared_ptr<Array> result = sortArray(stream, query, settings);
+        reader.logStats();
+        return result;
+    }
+
+    /**
+     * Redistribute a local tupled array by hash, streaming its dst_instance_id partitions into the SG. Each partition
+     * keeps the input order, so if the input is sorted, every instance receives one sorted run per sender and can merge
+     * them with a RunMergeReader. Without a partitioning, the hash space is split evenly.
+     */
+    template <Handedness WHICH>
+    shared_ptr<Array> redistributeTupled(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings,
+                                         HashPartitioning const* partitioning = NULL, bool const broadcastHeavy = false)
+    {
+        PhaseTimer timer(settings.getProfile(), Profile::REDISTRIBUTE);
+        typedef ArrayReader<WHICH, READ_TUPLED> Reader;
+        HashPartitioning evenPartitioning(settings, query, false);
+        Reader reader(inputArray, settings);
+        shared_ptr<Array> stream(new TupledArrayStream<Reader>(makeTupledSchema<WHICH>(settings, query), reader, query, settings,
+                                                               partitioning ? partitioning : &evenPartitioning, broadcastHeavy));
+        shared_ptr<Array> result = redistributeToRandomAccess(stream, createDistribution(dtByRow), query->getDefaultArrayResidency(), query, shared_from_this());
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * Once the first array's keys are counted, shrink the bloom filter over them to BLOOM_BITS_PER_KEY bits per
+     * distinct key (about 1.4% false positives with two hash functions), unless the user set the size.
+     */
+    void sizeBloomFilter(BloomFilter& filter, HyperLogLog const& firstSketch, Settings const& settings)
+    {
+        static size_t const BLOOM_BITS_PER_KEY = 16;
+        if(!settings.bloomFilterSizeSet())
+        {
+            filter.fold(std::max<size_t>(firstSketch.estimate() * BLOOM_BITS_PER_KEY, 1024));
+        }
+    }
+
+    /**
+     * Log how full the bloom filter is, once complete, and add it to the profile.
+     */
+    void recordBloomFilter(BloomFilter const& filter, Settings const& settings)
+    {
+        size_t const bitsSet = filter.countSetBits();
+        LOG4CXX_DEBUG(logger, "EJ bloom filter "<<filter.getBitSize()<<" bits, "<<bitsSet<<" set, estimated false positive rate "
+                              <<filter.estimateFalsePositiveRate(bitsSet));
+        settings.getProfile().addBloomFilter(filter.getBitSize(), bitsSet);
+    }
+
+    /**
+     * Bucket count for a table of tuples that were partitioned by hash, from the global distinct key count.
+     */
+    size_t chooseLocalNumBuckets(HyperLogLog const& sketch, shared_ptr<Query>& query, Settings const& settings)
+    {
+        return chooseNumBucketsForGroups(sketch.estimate() / query->getInstancesCount(), settings.getNumHashBuckets());
+    }
+
+    /**
+     * Output size, assuming every key of the side with fewer distinct keys occurs on the other side.
+     */
+    size_t estimateOutputSize(HyperLogLog const& left, HyperLogLog const& right)
+    {
+        size_t const maxDistinct = std::max(left.estimate(), right.estimate());
+        return maxDistinct == 0 ? 0 : static_cast<size_t>(static_cast<double>(left.getCount()) * right.getCount() / maxDistinct);
     }
 
+    /**
+     * Send every cell of a local state array to the instance given by its last attribute.
+     */
+    shared_ptr<Array> redistributeByInstance(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings)
+    {
+        PhaseTimer timer(settings.getProfile(), Profile::REDISTRIBUTE);
+        HashPartitioning byInstance(settings, query, false);
+        byInstance.routeByInstance();
+        FlatArrayReader reader(inputArray);
+        shared_ptr<Array> stream(new TupledArrayStream<FlatArrayReader>(inputArray->getArrayDesc(), reader, query, settings, &byInstance));
+        shared_ptr<Array> result = redistributeToRandomAccess(stream, createDistribution(dtByRow), query->getDefaultArrayResidency(), query, shared_from_this());
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * Tuple the input into a local store and redistribute only the locators (keys, instance, position, hash) by hash.
+     * The store is returned in localStore, to fetch the matched tuples from later.
+     */
     template <Handedness WHICH>
-    shared_ptr<Array> sortedToPreSg(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings)
+    shared_ptr<Array> redistributeLocators(shared_ptr<Array> & inputArray, shared_ptr<Query>& query, Settings const& settings,
+                                           ChunkFilter<WHICH>* chunkFilterToGenerate, ChunkFilter<WHICH == LEFT ? RIGHT : LEFT> const* chunkFilterToApply,
+                                           BloomFilter* bloomFilterToGenerate,        BloomFilter const* bloomFilterToApply,
+                                           shared_ptr<Array>& localStore, HyperLogLog* sketchToGenerate = NULL)
     {
-        ArrayWriter<WRITE_SPLIT_ON_HASH> writer(settings, query, makeTupledSchema<WHICH>(settings, query));
-        ArrayReader<WHICH, READ_TUPLED> reader(inputArray, settings);
+        PhaseTimer timer(settings.getProfile(), Profile::REDISTRIBUTE);
+        typedef TuplingReader<WHICH, false, false> Reader;
+        Reader reader(inputArray, settings, chunkFilterToGenerate, chunkFilterToApply, bloomFilterToGenerate, bloomFilterToApply, NULL, sketchToGenerate);
+        LocatorSource<Reader> locators(reader, settings, query, makeTupledSchema<WHICH>(settings, query));
+        HashPartitioning evenPartitioning(settings, query, false);
+        shared_ptr<Array> stream(new TupledArrayStream<LocatorSource<Reader> >(makeLocatorSchema<WHICH>(settings, query), locators, query, settings, &evenPartitioning));
+        shared_ptr<Array> result = redistributeToRandomAccess(stream, createDistribution(dtByRow), query->getDefaultArrayResidency(), query, shared_from_this());
+        reader.logStats();
+        localStore = locators.finalizeStore();
+        profileResult(timer, result);
+        return result;
+    }
+
+    /**
+     * Emit the cross product of a block of left tuples and a right run that has been spilled: one pass over the run per
+     * block.
+     */
+    void joinSpilledRun(TupleRun<LEFT>& leftBlock, TupleRun<RIGHT>& rightRun, ArrayWriter<WRITE_OUTPUT>& output, Settings const& settings)
+    {
+        ArrayReader<RIGHT, READ_TUPLED> reader(rightRun.getSpilled(), settings);
         while(!reader.end())
         {
-            writer.writeTuple(reader.getTuple());
+            vector<Value const*> const& rightTuple = reader.getTuple();
+            for(size_t i=0; i<leftBlock.size(); ++i)
+            {
+                output.writeTuple(leftBlock.getTuple(i), rightTuple);
+            }
+            reader.next();
+        }
+        leftBlock.clear();
+    }
+
+    /**
+     * Step a merge join reader past a tuple that has no match on the other side. Outer tuples are all written out;
+     * otherwise, after GALLOP_AFTER such steps in a row, the reader skips straight to the other side's tuple.
+     */
+    template <Handedness WHICH, bool OUTER, typename READER>
+    void skipUnmatched(READER& reader, vector<Value const*> const& otherTuple, uint32_t const otherHash, size_t& misses,
+                       ArrayWriter<WRITE_OUTPUT>& output)
+    {
+        size_t const GALLOP_AFTER = 8;
+        if(OUTER)
+        {
+            output.writeOuterTuple<WHICH>(reader.getTuple());
+            reader.next();
+        }
+        else if(++misses < GALLOP_AFTER)
+        {
             reader.next();
         }
-        return writer.finalize();
+        else
+        {
+            reader.skipTo(otherTuple, otherHash);
+            misses = 0;
+        }
     }
 
-    template <bool LEFT_OUTER = false, bool RIGHT_OUTER = false>
+    /**
+     * Join two inputs that are both ordered on (hash, keys). The readers are either ArrayReader<READ_SORTED> over
+     * a locally sorted array or RunMergeReader over an array of sorted runs.
+     */
+    template <bool LEFT_OUTER = false, bool RIGHT_OUTER = false,
+              typename LEFT_READER = ArrayReader<LEFT, READ_SORTED>, typename RIGHT_READER = ArrayReader<RIGHT, READ_SORTED> >
     shared_ptr<Array> localSortedMergeJoin(shared_ptr<Array>& leftSorted, shared_ptr<Array>& rightSorted, shared_ptr<Query>& query, Settings const& settings)
     {
-        ArrayWriter<WRITE_OUTPUT> output(settings, query, _schema);
+        ArrayWriter<WRITE_OUTPUT> output(settings, query, _joinSchema);
         vector<AttributeComparator> const& comparators = settings.getKeyComparators();
         size_t const numKeys = settings.getNumKeys();
-        ArrayReader<LEFT, READ_SORTED>  leftReader (leftSorted,  settings);
-        ArrayReader<RIGHT, READ_SORTED> rightReader(rightSorted, settings);
+        LEFT_READER  leftReader (leftSorted,  settings);
+        RIGHT_READER rightReader(rightSorted, settings);
         vector<Value> previousLeftKeys(numKeys);
-        Coordinate previousRightIdx = -1;
+        //a run of equal keys on the right is read once and replayed from memory for every left tuple with those keys
+        size_t const runBytes = settings.getRunByteLimit();
+        TupleRun<RIGHT> rightRun(settings, query, runBytes, true);
+        TupleRun<LEFT>  leftBlock(settings, query, runBytes, false);
         size_t const leftTupleSize = settings.getLeftTupleSize();
         size_t const rightTupleSize = settings.getRightTupleSize();
+        size_t leftMisses = 0, rightMisses = 0;
         while(!leftReader.end() && !rightReader.end())
         {
             vector<Value const*> const* leftTuple  = &(leftReader.getTuple());
@@ -496,56 +1369,29 @@ public:
             }
             uint32_t leftHash = ((*leftTuple)[leftTupleSize])->getUint32();
             uint32_t rightHash =((*rightTuple)[rightTupleSize])->getUint32();
-            if(leftHash < rightHash)
-            {
-                if(LEFT_OUTER)
-                {
-                    output.writeOuterTuple<LEFT>(*leftTuple);
-                }
-                leftReader.next();
-                continue;
-            }
-            else if(rightHash < leftHash)
+            if(leftHash < rightHash || (leftHash == rightHash && JoinHashTable::keysLess(*leftTuple, *rightTuple, comparators, numKeys)))
             {
-                if(RIGHT_OUTER)
-                {
-                    output.writeOuterTuple<RIGHT>(*rightTuple);
-                }
-                rightReader.next();
+                skipUnmatched<LEFT, LEFT_OUTER>(leftReader, *rightTuple, rightHash, leftMisses, output);
+                rightMisses = 0;
                 continue;
             }
-            else if(JoinHashTable::keysLess(*leftTuple, *rightTuple, comparators, numKeys))
+            else if(rightHash < leftHash || JoinHashTable::keysLess(*rightTuple, *leftTuple, comparators, numKeys))
             {
-                if(LEFT_OUTER)
-                {
-                    output.writeOuterTuple<LEFT>(*leftTuple);
-                }
-                leftReader.next();
+                skipUnmatched<RIGHT, RIGHT_OUTER>(rightReader, *leftTuple, leftHash, rightMisses, output);
+                leftMisses = 0;
                 continue;
             }
-            else if(JoinHashTable::keysLess(*rightTuple, *leftTuple, comparators, numKeys))
+            //JOIN TIME!
+            leftMisses = 0;
+            rightMisses = 0;
+            for(size_t i=0; i<numKeys; ++i)
             {
-                if(RIGHT_OUTER)
-                {
-                    output.writeOuterTuple<RIGHT>(*rightTuple);
-                }
-                rightReader.next();
-                continue;
+                previousLeftKeys[i] = *((*leftTuple)[i]); //remember the keys from the left tuple
             }
-            //JOIN TIME!
-            bool first = true;
+            rightRun.clear();
             while(!rightReader.end() && rightHash == leftHash && JoinHashTable::keysEqual(*leftTuple, *rightTuple, numKeys))
             {
-                if(first)
-                {
-                    for(size_t i=0; i<numKeys; ++i)
-                    {
-                        previousLeftKeys[i] = *((*leftTuple)[i]); //remember the keys from the left tuple
-                    }
-                    previousRightIdx = rightReader.getIdx(); //remember where the rightReader was in case we need to rewind later
-                    first = false;
-                }
-                output.writeTuple(*leftTuple, *rightTuple);
+                rightRun.add(*rightTuple);
                 rightReader.next();
                 if(!rightReader.end())
                 {
@@ -557,17 +1403,39 @@ public:
                     }
                 }
             }
-            leftReader.next();
-            if(!leftReader.end())  //if the keys in the left reader are repeated, rewind the right reader to where it was
+            while(true) //all the left tuples with these keys
             {
+                if(rightRun.isSpilled())
+                {
+                    leftBlock.add(*leftTuple);
+                    if(leftBlock.isFull())
+                    {
+                        joinSpilledRun(leftBlock, rightRun, output, settings);
+                    }
+                }
+                else
+                {
+                    for(size_t i=0; i<rightRun.size(); ++i)
+                    {
+                        output.writeTuple(*leftTuple, rightRun.getTuple(i));
+                    }
+                }
+                leftReader.next();
+                if(leftReader.end())
+                {
+                    break;
+                }
                 leftTuple = &(leftReader.getTuple());
-                uint32_t nextLeftHash = ((*leftTuple)[leftTupleSize])->getUint32();
-                if(leftHash == nextLeftHash && (!LEFT_OUTER || !isNullTuple(*leftTuple, numKeys)) && JoinHashTable::keysEqual( &(previousLeftKeys[0]), *leftTuple, numKeys) && !first)
+                if(((*leftTuple)[leftTupleSize])->getUint32() != leftHash || (LEFT_OUTER && isNullTuple(*leftTuple, numKeys)) ||
+                   !JoinHashTable::keysEqual( &(previousLeftKeys[0]), *leftTuple, numKeys))
                 {
-                    rightReader.setIdx(previousRightIdx);
-                    rightTuple = &rightReader.getTuple();
+                    break;
                 }
             }
+            if(leftBlock.size())
+            {
+                joinSpilledRun(leftBlock, rightRun, output, settings);
+            }
         }
         while(LEFT_OUTER && !leftReader.end())
         {
@@ -579,60 +1447,60 @@ public:
             output.writeOuterTuple<RIGHT> (rightReader.getTuple());
             rightReader.next();
         }
+        leftReader.logSkipStats();
+        rightReader.logSkipStats();
         return output.finalize();
     }
 
+    /**
+     * Join two tupled arrays whose matching tuples are on the same instance: read one into a hash table if it's small
+     * enough, or sort and merge. With sortedRuns, both arrays hold sorted runs from redistributeTupled. The distinct
+     * key counts are for this instance and size the hash table.
+     */
     template <Handedness WHICH_FIRST, bool LEFT_OUTER, bool RIGHT_OUTER>
-    shared_ptr<Array> globalMergeJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings)
+    shared_ptr<Array> localJoin(shared_ptr<Array>& first, shared_ptr<Array>& second, shared_ptr<Query>& query, Settings const& settings,
+                                bool const sortedRuns, size_t const firstDistinct, size_t const secondDistinct)
     {
-        shared_ptr<Array>& first = (WHICH_FIRST == LEFT ? inputArrays[0] : inputArrays[1]);
-        shared_ptr<ChunkFilter <WHICH_FIRST> > chunkFilter;
-        shared_ptr<BloomFilter> bloomFilter;
-        if ((WHICH_FIRST == LEFT && !RIGHT_OUTER) || (WHICH_FIRST == RIGHT && !LEFT_OUTER)) //if second array is not outer, then use first array to filter it!
-        {
-            chunkFilter.reset(new ChunkFilter<WHICH_FIRST>(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()));
-            bloomFilter.reset(new BloomFilter(settings.getBloomFilterSize()));
-        }
-        bool const KEEP_FIRST_NULL_TUPLES = ((WHICH_FIRST == LEFT && LEFT_OUTER) || (WHICH_FIRST == RIGHT && RIGHT_OUTER));
-        bool const HASH_NULLS = (LEFT_OUTER || RIGHT_OUTER); //hashes gotta match
-        first = readIntoPreSort<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(first, query, settings, chunkFilter.get(), NULL, bloomFilter.get(), NULL);
-        first = sortArray(first, query, settings);
-        first = sortedToPreSg<WHICH_FIRST>(first, query, settings);
-        first = redistributeToRandomAccess(first,createDistribution(dtByRow),query->getDefaultArrayResidency(), query, shared_from_this());
-        if(chunkFilter.get())
-        {
-            chunkFilter->globalExchange(query);
-            bloomFilter->globalExchange(query);
-        }
         Handedness const WHICH_SECOND = (WHICH_FIRST == LEFT ? RIGHT : LEFT);
-        bool const KEEP_SECOND_NULL_TUPLES = ((WHICH_SECOND == LEFT && LEFT_OUTER) || (WHICH_SECOND == RIGHT && RIGHT_OUTER));
-        shared_ptr<Array>& second = (WHICH_SECOND == LEFT ? inputArrays[0] : inputArrays[1]);
-        second = readIntoPreSort<WHICH_SECOND, KEEP_SECOND_NULL_TUPLES, HASH_NULLS>(second, query, settings, NULL, chunkFilter.get(), NULL, bloomFilter.get());
-        second = sortArray(second, query, settings);
-        second = sortedToPreSg<WHICH_SECOND>(second, query, settings);
-        second = redistributeToRandomAccess(second,createDistribution(dtByRow),query->getDefaultArrayResidency(), query, shared_from_this());
-
+        bool const FIRST_OUTER  = (WHICH_FIRST == LEFT ? LEFT_OUTER : RIGHT_OUTER);
+        bool const SECOND_OUTER = (WHICH_FIRST == LEFT ? RIGHT_OUTER : LEFT_OUTER);
         size_t const firstOverhead  = computeArrayOverhead<WHICH_FIRST>(first, query, settings);
         size_t const secondOverhead = computeArrayOverhead<WHICH_SECOND>(second, query, settings);
-        LOG4CXX_DEBUG(logger, "EJ merge after SG first overhead "<<firstOverhead<<" second overhead "<<secondOverhead);
-        //if one of the arrays is small enough, and it's not being outer-joined, we can read it into table! Note: this is a local decision
-        if (firstOverhead < settings.getHashJoinThreshold() && ((WHICH_FIRST == LEFT && !LEFT_OUTER) || (WHICH_FIRST == RIGHT && !RIGHT_OUTER)))
+        LOG4CXX_DEBUG(logger, "EJ local join first overhead "<<firstOverhead<<" second overhead "<<secondOverhead);
+        //if one of the arrays is small enough, we can read it into table! Note: this is a local decision. If the table side is
+        //outer-joined, its unmatched tuples are emitted after the probe; the partitions are disjoint so no exchange is needed.
+        //If the table outgrows the estimate by too much, it is dropped and we go on to the next option.
+        if (firstOverhead < settings.getHashJoinThreshold())
         {
             LOG4CXX_DEBUG(logger, "EJ merge rehashing first");
             ArenaPtr operatorArena = this->getArena();
-            ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::globalJoinMerge()A").resetting(true).threading(false).pagesize(8 * 1024 * 1204).parent(operatorArena)));
-            JoinHashTable table(settings, hashArena, WHICH_FIRST == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize());
-            readIntoHashTable<WHICH_FIRST, READ_TUPLED> (first, table, settings);
-            return arrayToTableJoin<WHICH_FIRST, READ_TUPLED, LEFT_OUTER || RIGHT_OUTER>( second, table, query, settings);
+            ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::globalJoinMerge()A").resetting(true).threading(false).pagesize(8 * 1024 * 1024).parent(operatorArena)));
+            JoinHashTable table(settings, hashArena, WHICH_FIRST == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize(),
+                                chooseNumBucketsForGroups(firstDistinct, settings.getNumHashBuckets()));
+            if(readIntoHashTable<WHICH_FIRST, READ_TUPLED, FIRST_OUTER> (first, table, settings, NULL, settings.getHashTableByteLimit()))
+            {
+                return arrayToTableJoin<WHICH_FIRST, READ_TUPLED, SECOND_OUTER, FIRST_OUTER>( second, table, query, settings);
+            }
+            LOG4CXX_DEBUG(logger, "EJ first table too large, falling back");
         }
-        else if(secondOverhead < settings.getHashJoinThreshold() && ((WHICH_FIRST == RIGHT && !LEFT_OUTER) || (WHICH_FIRST == LEFT && !RIGHT_OUTER)))
+        if(secondOverhead < settings.getHashJoinThreshold())
         {
             LOG4CXX_DEBUG(logger, "EJ merge rehashing second");
             ArenaPtr operatorArena = this->getArena();
-            ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::globalJoinMerge()B").resetting(true).threading(false).pagesize(8 * 1024 * 1204).parent(operatorArena)));
-            JoinHashTable table(settings, hashArena, WHICH_FIRST == LEFT ? settings.getRightTupleSize() : settings.getLeftTupleSize());
-            readIntoHashTable<WHICH_SECOND, READ_TUPLED> (second, table, settings);
-            return arrayToTableJoin<WHICH_SECOND, READ_TUPLED, LEFT_OUTER || RIGHT_OUTER>( first, table, query, settings);
+            ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::globalJoinMerge()B").resetting(true).threading(false).pagesize(8 * 1024 * 1024).parent(operatorArena)));
+            JoinHashTable table(settings, hashArena, WHICH_FIRST == LEFT ? settings.getRightTupleSize() : settings.getLeftTupleSize(),
+                                chooseNumBucketsForGroups(secondDistinct, settings.getNumHashBuckets()));
+            if(readIntoHashTable<WHICH_SECOND, READ_TUPLED, SECOND_OUTER> (second, table, settings, NULL, settings.getHashTableByteLimit()))
+            {
+                return arrayToTableJoin<WHICH_SECOND, READ_TUPLED, FIRST_OUTER, SECOND_OUTER>( first, table, query, settings);
+            }
+            LOG4CXX_DEBUG(logger, "EJ second table too large, falling back");
+        }
+        if(sortedRuns)
+        {
+            LOG4CXX_DEBUG(logger, "EJ merge sorted runs");
+            return WHICH_FIRST == LEFT ? localSortedMergeJoin<LEFT_OUTER, RIGHT_OUTER, RunMergeReader<LEFT>, RunMergeReader<RIGHT> >(first, second, query, settings) :
+                                         localSortedMergeJoin<LEFT_OUTER, RIGHT_OUTER, RunMergeReader<LEFT>, RunMergeReader<RIGHT> >(second, first, query, settings);
         }
         else
         {
@@ -645,57 +1513,856 @@ public:
         }
     }
 
-    shared_ptr< Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query) override
+    /**
+     * Join arrays that are already co-located (see inputsColocated): tuple both locally, filtering the second with
+     * the first, and join them on this instance. Nothing is sent over the network.
+     */
+    template <Handedness WHICH_FIRST, bool LEFT_OUTER, bool RIGHT_OUTER>
+    shared_ptr<Array> colocatedJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings)
     {
-        vector<ArrayDesc const*> inputSchemas(2);
-        inputSchemas[0] = &inputArrays[0]->getArrayDesc();
-        inputSchemas[1] = &inputArrays[1]->getArrayDesc();
-        LOG4CXX_DEBUG(logger, "execute - Checking attributes.");
-        Settings settings(inputSchemas, _parameters, _kwParameters, query);
-        Settings::algorithm algo = pickAlgorithm(inputArrays, query, settings);
-        if(algo == Settings::HASH_REPLICATE_LEFT)
+        Handedness const WHICH_SECOND = (WHICH_FIRST == LEFT ? RIGHT : LEFT);
+        shared_ptr<Array>& first  = (WHICH_FIRST  == LEFT ? inputArrays[0] : inputArrays[1]);
+        shared_ptr<Array>& second = (WHICH_SECOND == LEFT ? inputArrays[0] : inputArrays[1]);
+        shared_ptr<ChunkFilter <WHICH_FIRST> > chunkFilter;
+        shared_ptr<BloomFilter> bloomFilter;
+        if ((WHICH_FIRST == LEFT && !RIGHT_OUTER) || (WHICH_FIRST == RIGHT && !LEFT_OUTER))
         {
-            LOG4CXX_DEBUG(logger, "EJ running hash_replicate_left");
-            return replicationHashJoin<LEFT>(inputArrays, query, settings);
+            chunkFilter.reset(new ChunkFilter<WHICH_FIRST>(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()));
+            bloomFilter.reset(new BloomFilter(settings.getBloomFilterSize()));
         }
-        else if (algo == Settings::HASH_REPLICATE_RIGHT)
+        MemoryCharge filterCharge(settings.getMemoryUsage(), "chunk and bloom filters",
+                                  chunkFilter.get() ? chunkFilter->getByteSize() + bloomFilter->getByteSize() : 0);
+        bool const KEEP_FIRST_NULL_TUPLES  = ((WHICH_FIRST  == LEFT && LEFT_OUTER) || (WHICH_FIRST  == RIGHT && RIGHT_OUTER));
+        bool const KEEP_SECOND_NULL_TUPLES = ((WHICH_SECOND == LEFT && LEFT_OUTER) || (WHICH_SECOND == RIGHT && RIGHT_OUTER));
+        bool const HASH_NULLS = (LEFT_OUTER || RIGHT_OUTER);
+        HyperLogLog firstSketch;
+        HyperLogLog secondSketch;
+        first = readIntoPreSg<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(first, query, settings, chunkFilter.get(), NULL, bloomFilter.get(), NULL, NULL, &firstSketch);
+        if(bloomFilter.get())
         {
-            LOG4CXX_DEBUG(logger, "EJ running hash_replicate_right");
-            return replicationHashJoin<RIGHT>(inputArrays, query, settings);
+            sizeBloomFilter(*bloomFilter, firstSketch, settings);
+            recordBloomFilter(*bloomFilter, settings);
         }
-        else if (algo == Settings::MERGE_LEFT_FIRST)
+        second = readIntoPreSg<WHICH_SECOND, KEEP_SECOND_NULL_TUPLES, HASH_NULLS>(second, query, settings, NULL, chunkFilter.get(), NULL, bloomFilter.get(), NULL, &secondSketch);
+        return localJoin<WHICH_FIRST, LEFT_OUTER, RIGHT_OUTER>(first, second, query, settings, false, firstSketch.estimate(), secondSketch.estimate());
+    }
+
+    /**
+     * Join arrays whose keys are exactly their dimensions, on the same chunk grid: every cell matches at most one
+     * cell, in the chunk at the same position. Unless the arrays are co-located, whole chunks are redistributed by
+     * position first. Then each chunk of the left array is merged with the chunk at the same position of the right
+     * one, in cell order. No tuples are hashed, stored or sorted.
+     */
+    template <bool LEFT_OUTER, bool RIGHT_OUTER>
+    shared_ptr<Array> alignedChunkJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings)
+    {
+        bool const colocated = inputsColocated(inputArrays, query, settings);
+        for(size_t i=0; i<2; ++i)
         {
-            LOG4CXX_DEBUG(logger, "EJ running merge_left_first");
-            if(settings.isLeftOuter() && settings.isRightOuter())
-            {
-                return globalMergeJoin<LEFT, true, true>(inputArrays, query, settings);
-            }
-            if(settings.isLeftOuter())
+            if(!colocated)
             {
-                return globalMergeJoin<LEFT, true, false>(inputArrays, query, settings);
+                PhaseTimer timer(settings.getProfile(), Profile::REDISTRIBUTE);
+                inputArrays[i] = redistributeToRandomAccess(inputArrays[i], createDistribution(dtHashPartitioned), query->getDefaultArrayResidency(),
+                                                            query, shared_from_this());
+                profileResult(timer, inputArrays[i]);
             }
-            if(settings.isRightOuter())
+            else if(inputArrays[i]->getSupportedAccess() == Array::SINGLE_PASS)
             {
-                return globalMergeJoin<LEFT, false, true>(inputArrays, query, settings);
+                inputArrays[i] = ensureRandomAccess(inputArrays[i], query);
             }
-            return globalMergeJoin<LEFT, false, false>(inputArrays, query, settings);
         }
-        else
+        ChunkCellReader<LEFT>  left (inputArrays[0], settings);
+        ChunkCellReader<RIGHT> right(inputArrays[1], settings);
+        ArrayWriter<WRITE_OUTPUT> output(settings, query, _joinSchema);
+        size_t leftChunks = 0, pairedChunks = 0, matches = 0;
+        shared_ptr<ConstArrayIterator> aiter = inputArrays[0]->getConstIterator(*inputArrays[0]->getArrayDesc().getEmptyBitmapAttribute());
+        while(!aiter->end())
         {
-            LOG4CXX_DEBUG(logger, "EJ running merge_right_first");
-            if(settings.isLeftOuter() && settings.isRightOuter())
+            Coordinates const& chunkPos = aiter->getPosition();
+            ++leftChunks;
+            if(right.setChunk(chunkPos))
             {
-                return globalMergeJoin<RIGHT, true, true>(inputArrays, query, settings);
+                ++pairedChunks;
             }
-            if(settings.isLeftOuter())
+            else if(!LEFT_OUTER)
             {
-                return globalMergeJoin<RIGHT, true, false>(inputArrays, query, settings);
+                ++(*aiter);
+                continue;
             }
-            if(settings.isRightOuter())
+            left.setChunk(chunkPos);
+            while(!left.end() && !right.end())
+            {
+                int const cmp = ChunkCellReader<LEFT>::compareCells(left.getPosition(), right.getPosition());
+                if(cmp < 0)
+                {
+                    if(LEFT_OUTER)
+                    {
+                        output.writeOuterTuple<LEFT>(left.getTuple());
+                    }
+                    left.next();
+                }
+                else if(cmp > 0)
+                {
+                    if(RIGHT_OUTER)
+                    {
+                        output.writeOuterTuple<RIGHT>(right.getTuple());
+                    }
+                    right.next();
+                }
+                else
+                {
+                    output.writeTuple(left.getTuple(), right.getTuple());
+                    ++matches;
+                    left.next();
+                    right.next();
+                }
+            }
+            while(LEFT_OUTER && !left.end())
             {
-                return globalMergeJoin<RIGHT, false, true>(inputArrays, query, settings);
+                output.writeOuterTuple<LEFT>(left.getTuple());
+                left.next();
             }
-            return globalMergeJoin<RIGHT, false, false>(inputArrays, query, settings);
+            while(RIGHT_OUTER && !right.end())
+            {
+                output.writeOuterTuple<RIGHT>(right.getTuple());
+                right.next();
+            }
+            ++(*aiter);
+        }
+        if(RIGHT_OUTER) //right chunks with no left chunk at the same position
+        {
+            aiter = inputArrays[1]->getConstIterator(*inputArrays[1]->getArrayDesc().getEmptyBitmapAttribute());
+            while(!aiter->end())
+            {
+                Coordinates const& chunkPos = aiter->getPosition();
+                if(!left.setChunk(chunkPos))
+                {
+                    right.setChunk(chunkPos);
+                    while(!right.end())
+                    {
+                        output.writeOuterTuple<RIGHT>(right.getTuple());
+                        right.next();
+                    }
+                }
+                ++(*aiter);
+            }
+        }
+        LOG4CXX_DEBUG(logger, "EJ aligned join colocated "<<colocated<<" left chunks "<<leftChunks<<" paired "<<pairedChunks<<" matches "<<matches);
+        return output.finalize();
+    }
+
+    struct LookupProbe
+    {
+        Coordinates chunkPos;
+        Coordinates cellPos;
+        size_t      tupleNo;
+    };
+
+    /**
+     * Index nested-loop join: replicate the SMALL side, turn the keys of each of its tuples into a cell position of
+     * the other array (which is keyed on all of its dimensions), and read only those cells, chunk by chunk, with
+     * setPosition. Positions outside the array or in chunks that aren't local are skipped; keys that are attributes
+     * are compared after the cell is found. Inner joins only.
+     */
+    template <Handedness WHICH_SMALL>
+    shared_ptr<Array> lookupJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings)
+    {
+        if(settings.isLeftOuter() || settings.isRightOuter())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        Handedness const WHICH_BIG = (WHICH_SMALL == LEFT ? RIGHT : LEFT);
+        shared_ptr<Array> small = (WHICH_SMALL == LEFT ? inputArrays[0] : inputArrays[1]);
+        shared_ptr<Array>& big  = (WHICH_SMALL == LEFT ? inputArrays[1] : inputArrays[0]);
+        small = replicate(small, query, settings);
+        if(big->getSupportedAccess() == Array::SINGLE_PASS)
+        {
+            big = ensureRandomAccess(big, query);
+        }
+        size_t const tupleSize = (WHICH_SMALL == LEFT ? settings.getLeftTupleSize() : settings.getRightTupleSize());
+        size_t const numKeys   = settings.getNumKeys();
+        size_t const bigAttrs  = (WHICH_BIG == LEFT ? settings.getNumLeftAttrs() : settings.getNumRightAttrs());
+        Dimensions const& dims = big->getArrayDesc().getDimensions();
+        size_t const nDims     = dims.size();
+        vector<size_t> dimKeys(nDims);
+        for(size_t d=0; d<nDims; ++d)
+        {
+            dimKeys[d] = (WHICH_BIG == LEFT ? settings.mapLeftToTuple(bigAttrs + d) : settings.mapRightToTuple(bigAttrs + d));
+        }
+        PhaseTimer buildTimer(settings.getProfile(), Profile::BUILD);
+        vector<Value> tuples;
+        vector<LookupProbe> probes;
+        MemoryCharge probeCharge(settings.getMemoryUsage(), "lookup probes");
+        size_t const probeBytes = sizeof(LookupProbe) + 2 * nDims * sizeof(Coordinate) + tupleSize * sizeof(Value);
+        size_t outOfBounds = 0;
+        ArrayReader<WHICH_SMALL, READ_INPUT> reader(small, settings);
+        while(!reader.end())
+        {
+            vector<Value const*> const& tuple = reader.getTuple();
+            LookupProbe probe;
+            probe.chunkPos.resize(nDims);
+            probe.cellPos.resize(nDims);
+            probe.tupleNo = tuples.size() / tupleSize;
+            bool inBounds = true;
+            for(size_t d=0; d<nDims && inBounds; ++d)
+            {
+                Coordinate const c     = tuple[dimKeys[d]]->getInt64();
+                Coordinate const start = dims[d].getStartMin();
+                Coordinate const interval = dims[d].getChunkInterval();
+                inBounds = c >= start && c <= dims[d].getEndMax();
+                probe.cellPos[d]  = c;
+                probe.chunkPos[d] = start + ((c - start) / interval) * interval;
+            }
+            if(inBounds)
+            {
+                for(size_t i=0; i<tupleSize; ++i)
+                {
+                    tuples.push_back(*(tuple[i]));
+                }
+                probes.push_back(probe);
+                if(probes.size() % 1024 == 0)
+                {
+                    probeCharge.resize(probes.size() * probeBytes);
+                }
+            }
+            else
+            {
+                ++outOfBounds;
+            }
+            reader.next();
+        }
+        std::sort(probes.begin(), probes.end(), [](LookupProbe const& a, LookupProbe const& b)
+        {
+            int const cmp = ChunkCellReader<WHICH_BIG>::compareCells(a.chunkPos, b.chunkPos);
+            return cmp != 0 ? cmp < 0 : ChunkCellReader<WHICH_BIG>::compareCells(a.cellPos, b.cellPos) < 0;
+        });
+        buildTimer.addRows(probes.size());
+        buildTimer.addBytes(probes.size() * probeBytes);
+        buildTimer.stop();
+        ChunkCellReader<WHICH_BIG> cells(big, settings);
+        ArrayWriter<WRITE_OUTPUT> output(settings, query, _joinSchema);
+        size_t chunksRead = 0, hits = 0, matches = 0;
+        size_t i = 0;
+        while(i < probes.size())
+        {
+            Coordinates const& chunkPos = probes[i].chunkPos;
+            bool const haveChunk = cells.setChunk(chunkPos);
+            chunksRead += haveChunk;
+            for(; i < probes.size() && probes[i].chunkPos == chunkPos; ++i)
+            {
+                if(!haveChunk || !cells.setCell(probes[i].cellPos))
+                {
+                    continue;
+                }
+                ++hits;
+                Value const* smallTuple = &(tuples[probes[i].tupleNo * tupleSize]);
+                vector<Value const*> const& bigTuple = cells.getTuple();
+                if(!JoinHashTable::keysEqual(smallTuple, bigTuple, numKeys))
+                {
+                    continue;
+                }
+                ++matches;
+                if(WHICH_SMALL == LEFT)
+                {
+                    output.writeTuple(smallTuple, bigTuple);
+                }
+                else
+                {
+                    output.writeTuple(bigTuple, smallTuple);
+                }
+            }
+        }
+        LOG4CXX_DEBUG(logger, "EJ lookup join probes "<<probes.size()<<" out of bounds "<<outOfBounds<<" local chunks read "<<chunksRead
+                              <<" cells found "<<hits<<" matches "<<matches);
+        return output.finalize();
+    }
+
+    /**
+     * Share the key sketch of the first array and, if the second is to be filtered, the chunk and bloom filters made
+     * from the first.
+     */
+    template <Handedness WHICH_FIRST>
+    void exchangeFilters(HyperLogLog& firstSketch, ChunkFilter<WHICH_FIRST>* chunkFilter, BloomFilter* bloomFilter, shared_ptr<Query>& query,
+                         Settings const& settings)
+    {
+        PhaseTimer timer(settings.getProfile(), Profile::FILTER_EXCHANGE);
+        firstSketch.globalExchange(query);
+        if(chunkFilter)
+        {
+            sizeBloomFilter(*bloomFilter, firstSketch, settings);
+            chunkFilter->globalExchange(query);
+            bloomFilter->globalExchange(query);
+            recordBloomFilter(*bloomFilter, settings);
+            timer.addBytes(chunkFilter->getByteSize() + bloomFilter->getByteSize());
+        }
+    }
+
+    template <Handedness WHICH_FIRST, bool LEFT_OUTER, bool RIGHT_OUTER>
+    shared_ptr<Array> globalMergeJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings,
+                                      shared_ptr<Array> const& firstReplicated)
+    {
+        shared_ptr<Array>& first = (WHICH_FIRST == LEFT ? inputArrays[0] : inputArrays[1]);
+        shared_ptr<ChunkFilter <WHICH_FIRST> > chunkFilter;
+        shared_ptr<BloomFilter> bloomFilter;
+        if ((WHICH_FIRST == LEFT && !RIGHT_OUTER) || (WHICH_FIRST == RIGHT && !LEFT_OUTER)) //if second array is not outer, then use first array to filter it!
+        {
+            chunkFilter.reset(new ChunkFilter<WHICH_FIRST>(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()));
+            bloomFilter.reset(new BloomFilter(settings.getBloomFilterSize()));
+        }
+        MemoryCharge filterCharge(settings.getMemoryUsage(), "chunk and bloom filters",
+                                  chunkFilter.get() ? chunkFilter->getByteSize() + bloomFilter->getByteSize() : 0);
+        bool const KEEP_FIRST_NULL_TUPLES = ((WHICH_FIRST == LEFT && LEFT_OUTER) || (WHICH_FIRST == RIGHT && RIGHT_OUTER));
+        bool const HASH_NULLS = (LEFT_OUTER || RIGHT_OUTER); //hashes gotta match
+        //if neither side can go into a hash table after the SG, we know we'll merge: sort before the SG and merge the
+        //received runs instead of sorting again after
+        bool const SORTED_RUNS = settings.getHashJoinThreshold() == 0;
+        Handedness const WHICH_SECOND = (WHICH_FIRST == LEFT ? RIGHT : LEFT);
+        bool const KEEP_SECOND_NULL_TUPLES = ((WHICH_SECOND == LEFT && LEFT_OUTER) || (WHICH_SECOND == RIGHT && RIGHT_OUTER));
+        shared_ptr<Array>& second = (WHICH_SECOND == LEFT ? inputArrays[0] : inputArrays[1]);
+        HyperLogLog firstSketch;
+        HyperLogLog secondSketch;
+        if(settings.isSkewHandling() && query->getInstancesCount() > 1)
+        {
+            //Tuple both sides before partitioning either, sampling the hashes of the second (larger) side. Its heavy
+            //hashes are spread round-robin and the matching rows of the first side are broadcast; that can't be
+            //done if the first side is outer as its unmatched rows would come out on every instance.
+            if(SORTED_RUNS)
+            {
+                first = tupleAndSort<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(first, query, settings, chunkFilter.get(), NULL, bloomFilter.get(), NULL, NULL, &firstSketch);
+            }
+            else
+            {
+                first = readIntoPreSg<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(first, query, settings, chunkFilter.get(), NULL, bloomFilter.get(), NULL, NULL, &firstSketch);
+            }
+            exchangeFilters<WHICH_FIRST>(firstSketch, chunkFilter.get(), bloomFilter.get(), query, settings);
+            HashPartitioning partitioning(settings, query, !KEEP_FIRST_NULL_TUPLES);
+            if(SORTED_RUNS)
+            {
+                second = tupleAndSort<WHICH_SECOND, KEEP_SECOND_NULL_TUPLES, HASH_NULLS>(second, query, settings, NULL, chunkFilter.get(), NULL, bloomFilter.get(), &partitioning, &secondSketch);
+            }
+            else
+            {
+                second = readIntoPreSg<WHICH_SECOND, KEEP_SECOND_NULL_TUPLES, HASH_NULLS>(second, query, settings, NULL, chunkFilter.get(), NULL, bloomFilter.get(), &partitioning, &secondSketch);
+            }
+            {
+                PhaseTimer timer(settings.getProfile(), Profile::SPLIT);
+                partitioning.globalExchange(query);
+            }
+            first  = redistributeTupled<WHICH_FIRST> (first,  query, settings, &partitioning, true);
+            second = redistributeTupled<WHICH_SECOND>(second, query, settings, &partitioning, false);
+        }
+        else
+        {
+            if(firstReplicated && !SORTED_RUNS)
+            {
+                first = tupleOwnPartition<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(firstReplicated, query, settings, chunkFilter.get(), bloomFilter.get(), &firstSketch);
+            }
+            else if(SORTED_RUNS)
+            {
+                first = tupleAndSort<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(first, query, settings, chunkFilter.get(), NULL, bloomFilter.get(), NULL, NULL, &firstSketch);
+                first = redistributeTupled<WHICH_FIRST>(first, query, settings);
+            }
+            else
+            {
+                first = tupleAndRedistribute<WHICH_FIRST, KEEP_FIRST_NULL_TUPLES, HASH_NULLS>(first, query, settings, chunkFilter.get(), NULL, bloomFilter.get(), NULL, &firstSketch);
+            }
+            exchangeFilters<WHICH_FIRST>(firstSketch, chunkFilter.get(), bloomFilter.get(), query, settings);
+            if(SORTED_RUNS)
+            {
+                second = tupleAndSort<WHICH_SECOND, KEEP_SECOND_NULL_TUPLES, HASH_NULLS>(second, query, settings, NULL, chunkFilter.get(), NULL, bloomFilter.get(), NULL, &secondSketch);
+                second = redistributeTupled<WHICH_SECOND>(second, query, settings);
+            }
+            else
+            {
+                second = tupleAndRedistribute<WHICH_SECOND, KEEP_SECOND_NULL_TUPLES, HASH_NULLS>(second, query, settings, NULL, chunkFilter.get(), NULL, bloomFilter.get(), &secondSketch);
+            }
+        }
+        {
+            PhaseTimer timer(settings.getProfile(), Profile::FILTER_EXCHANGE);
+            secondSketch.globalExchange(query);
+        }
+        LOG4CXX_DEBUG(logger, "EJ merge first count "<<firstSketch.getCount()<<" distinct keys "<<firstSketch.estimate()
+                              <<" second count "<<secondSketch.getCount()<<" distinct keys "<<secondSketch.estimate()
+                              <<" estimated output "<<estimateOutputSize(firstSketch, secondSketch));
+
+        return localJoin<WHICH_FIRST, LEFT_OUTER, RIGHT_OUTER>(first, second, query, settings, SORTED_RUNS,
+                                                              firstSketch.estimate()  / query->getInstancesCount(),
+                                                              secondSketch.estimate() / query->getInstancesCount());
+    }
+
+    /**
+     * Late materialization, inner joins only: redistribute and join the locators of both sides, then fetch the
+     * tuples of the matched pairs from the instances that read them. The left tuple of each pair is sent to the
+     * instance that holds the right tuple, which writes the output. Both fetches are sorted by position first, so each
+     * store is read in chunk order.
+     */
+    template <Handedness WHICH_FIRST>
+    shared_ptr<Array> lateMaterializationJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings)
+    {
+        if(settings.isLeftOuter() || settings.isRightOuter())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "Internal inconsistency";
+        }
+        Handedness const WHICH_SECOND = (WHICH_FIRST == LEFT ? RIGHT : LEFT);
+        shared_ptr<Array>& first  = (WHICH_FIRST  == LEFT ? inputArrays[0] : inputArrays[1]);
+        shared_ptr<Array>& second = (WHICH_SECOND == LEFT ? inputArrays[0] : inputArrays[1]);
+        ChunkFilter<WHICH_FIRST> chunkFilter(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc());
+        BloomFilter bloomFilter(settings.getBloomFilterSize());
+        MemoryCharge filterCharge(settings.getMemoryUsage(), "chunk and bloom filters", chunkFilter.getByteSize() + bloomFilter.getByteSize());
+        HyperLogLog firstSketch;
+        shared_ptr<Array> firstStore;
+        shared_ptr<Array> secondStore;
+        first = redistributeLocators<WHICH_FIRST>(first, query, settings, &chunkFilter, NULL, &bloomFilter, NULL, firstStore, &firstSketch);
+        exchangeFilters<WHICH_FIRST>(firstSketch, &chunkFilter, &bloomFilter, query, settings);
+        second = redistributeLocators<WHICH_SECOND>(second, query, settings, NULL, &chunkFilter, NULL, &bloomFilter, secondStore);
+        size_t const numKeys = settings.getNumKeys();
+        ArenaPtr operatorArena = this->getArena();
+        ArenaPtr hashArena(newArena(Options("PhysicalEquiJoin::lateMaterializationJoin()").resetting(true).threading(false).pagesize(8 * 1024 * 1024).parent(operatorArena)));
+        JoinHashTable table(settings, hashArena, numKeys + 3, chooseLocalNumBuckets(firstSketch, query, settings));
+        {
+            PhaseTimer timer(settings.getProfile(), Profile::BUILD);
+            FlatArrayReader reader(first);
+            while(!reader.end())
+            {
+                table.insert(reader.getTuple());
+                reader.next();
+            }
+            table.chargeBudget();
+            recordHashTableShape(table, settings);
+            timer.addRows(table.getNumTuples());
+            timer.addBytes(table.usedBytes());
+        }
+        first.reset();
+        //each matched pair is sent to the instance holding the left tuple as [left_pos, right_instance, right_pos, left_instance]
+        ArrayWriter<WRITE_TUPLED> requestWriter(settings, query, makeFetchRequestSchema(settings, query));
+        {
+            PhaseTimer timer(settings.getProfile(), Profile::PROBE);
+            vector<Value const*> request(4, NULL);
+            Value dst;
+            size_t numMatches = 0;
+            JoinHashTable::const_iterator iter = table.getIterator();
+            FlatArrayReader reader(second);
+            while(!reader.end())
+            {
+                vector<Value const*> const& tuple = reader.getTuple();
+                iter.find(tuple);
+                while(!iter.end() && iter.atKeys(tuple))
+                {
+                    Value const* tablePiece = iter.getTuple();
+                    Value const& leftInstance  = WHICH_FIRST == LEFT ? getValueFromTuple(tablePiece, numKeys)   : getValueFromTuple(tuple, numKeys);
+                    Value const& leftPos       = WHICH_FIRST == LEFT ? getValueFromTuple(tablePiece, numKeys+1) : getValueFromTuple(tuple, numKeys+1);
+                    Value const& rightInstance = WHICH_FIRST == LEFT ? getValueFromTuple(tuple, numKeys)        : getValueFromTuple(tablePiece, numKeys);
+                    Value const& rightPos      = WHICH_FIRST == LEFT ? getValueFromTuple(tuple, numKeys+1)      : getValueFromTuple(tablePiece, numKeys+1);
+                    dst.setUint32(safe_static_cast<uint32_t>(leftInstance.getInt64()));
+                    request[0] = &leftPos;
+                    request[1] = &rightInstance;
+                    request[2] = &rightPos;
+                    request[3] = &dst;
+                    requestWriter.writeTuple(request);
+                    ++numMatches;
+                    iter.nextAtHash();
+                }
+                reader.next();
+            }
+            LOG4CXX_DEBUG(logger, "EJ late materialization local matches "<<numMatches);
+        }
+        second.reset();
+        shared_ptr<Array> leftStore  = (WHICH_FIRST == LEFT ? firstStore  : secondStore);
+        shared_ptr<Array> rightStore = (WHICH_FIRST == LEFT ? secondStore : firstStore);
+        firstStore.reset();
+        secondStore.reset();
+        shared_ptr<Array> requests = requestWriter.finalize();
+        requests = redistributeByInstance(requests, query, settings);
+        requests = sortByPosition(requests, 0, query, settings);
+        //each left tuple is sent to the instance holding the right tuple as [left tuple..., right_pos, right_instance]
+        size_t const leftTupleSize = settings.getLeftTupleSize();
+        ArrayWriter<WRITE_TUPLED> fetchedWriter(settings, query, makeFetchedSchema(settings, query));
+        {
+            TupleFetcher fetcher(leftStore, query);
+            vector<Value const*> fetchedTuple(leftTupleSize + 2, NULL);
+            Value dst;
+            FlatArrayReader reader(requests);
+            while(!reader.end())
+            {
+                vector<Value const*> const& request = reader.getTuple();
+                vector<Value const*> const& leftTuple = fetcher.fetch(request[0]->getInt64());
+                for(size_t i=0; i<leftTupleSize; ++i)
+                {
+                    fetchedTuple[i] = leftTuple[i];
+                }
+                dst.setUint32(safe_static_cast<uint32_t>(request[1]->getInt64()));
+                fetchedTuple[leftTupleSize]   = request[2];
+                fetchedTuple[leftTupleSize+1] = &dst;
+                fetchedWriter.writeTuple(fetchedTuple);
+                reader.next();
+            }
+        }
+        requests.reset();
+        leftStore.reset();
+        shared_ptr<Array> fetched = fetchedWriter.finalize();
+        fetched = redistributeByInstance(fetched, query, settings);
+        fetched = sortByPosition(fetched, leftTupleSize, query, settings);
+        ArrayWriter<WRITE_OUTPUT> output(settings, query, _joinSchema);
+        {
+            TupleFetcher fetcher(rightStore, query);
+            FlatArrayReader reader(fetched);
+            while(!reader.end())
+            {
+                vector<Value const*> const& leftTuple = reader.getTuple();
+                output.writeTuple(leftTuple, fetcher.fetch(leftTuple[leftTupleSize]->getInt64()));
+                reader.next();
+            }
+        }
+        return output.finalize();
+    }
+
+    static char const* algorithmName(Settings::algorithm const algo)
+    {
+        switch(algo)
+        {
+        case Settings::HASH_REPLICATE_LEFT:  return "hash_replicate_left";
+        case Settings::HASH_REPLICATE_RIGHT: return "hash_replicate_right";
+        case Settings::MERGE_LEFT_FIRST:     return "merge_left_first";
+        case Settings::MERGE_RIGHT_FIRST:    return "merge_right_first";
+        case Settings::LATE_LEFT_FIRST:      return "late_left_first";
+        case Settings::LATE_RIGHT_FIRST:     return "late_right_first";
+        case Settings::COLOCATED:            return "colocated";
+        case Settings::ALIGNED_CHUNKS:       return "aligned_chunks";
+        case Settings::LOOKUP_LEFT:          return "lookup_left";
+        case Settings::LOOKUP_RIGHT:         return "lookup_right";
+        }
+        return "unknown";
+    }
+
+    /**
+     * explain:true - plan the join as execute would, but instead of running it, return what the plan is based on, as
+     * key-value pairs on every instance. The shuffle volume is the number of bytes the algorithm would send across
+     * the network in total, before any filtering; it's a lower bound (">=") when the pre-scan didn't finish. The
+     * pre-scan and the late materialization key sample still run, with their message rounds; inputs that can only be
+     * read once are not copied for them, see pickAlgorithm.
+     */
+    shared_ptr<Array> explainPlan(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings)
+    {
+        PlanInfo plan;
+        Settings::algorithm const algo = pickAlgorithm(inputArrays, query, settings, plan, false);
+        if(!plan.sized)
+        {
+            globalPreScan(inputArrays, query, settings, plan, false);
+        }
+        size_t const nInstances = query->getInstancesCount();
+        bool const colocated = inputsColocated(inputArrays, query, settings);
+        bool const exact = plan.leftFinished == nInstances && plan.rightFinished == nInstances;
+        size_t shuffleBytes = 0;
+        switch(algo)
+        {
+        case Settings::HASH_REPLICATE_LEFT:
+        case Settings::LOOKUP_LEFT:
+            shuffleBytes = plan.leftSize * (nInstances - 1);
+            break;
+        case Settings::HASH_REPLICATE_RIGHT:
+        case Settings::LOOKUP_RIGHT:
+            shuffleBytes = plan.rightSize * (nInstances - 1);
+            break;
+        case Settings::COLOCATED:
+            break;
+        case Settings::ALIGNED_CHUNKS:
+            if(colocated)
+            {
+                break;
+            }
+            // fall through
+        case Settings::LATE_LEFT_FIRST:  //the locators only; the fetched tuples depend on the number of matches
+        case Settings::LATE_RIGHT_FIRST:
+        case Settings::MERGE_LEFT_FIRST:
+        case Settings::MERGE_RIGHT_FIRST:
+        {
+            size_t const tupled = (algo == Settings::LATE_LEFT_FIRST || algo == Settings::LATE_RIGHT_FIRST) ?
+                JoinHashTable::computeTupleOverhead(makeLocatorSchema<LEFT>(settings, query).getAttributes(true)) : 0;
+            size_t leftBytes  = plan.leftSize, rightBytes = plan.rightSize;
+            if(tupled)
+            {
+                size_t const leftWidth  = JoinHashTable::computeTupleOverhead(makeTupledSchema<LEFT> (settings, query).getAttributes(true));
+                size_t const rightWidth = JoinHashTable::computeTupleOverhead(makeTupledSchema<RIGHT>(settings, query).getAttributes(true));
+                leftBytes  = leftBytes  / leftWidth  * tupled;
+                rightBytes = rightBytes / rightWidth * tupled;
+            }
+            shuffleBytes = (leftBytes + rightBytes) / nInstances * (nInstances - 1);
+            break;
+        }
+        }
+        Handedness const first = (algo == Settings::HASH_REPLICATE_RIGHT || algo == Settings::MERGE_RIGHT_FIRST ||
+                                  algo == Settings::LATE_RIGHT_FIRST     || algo == Settings::LOOKUP_RIGHT) ? RIGHT : LEFT;
+        bool const filtered = (algo != Settings::COLOCATED && algo != Settings::ALIGNED_CHUNKS && algo != Settings::LOOKUP_LEFT && algo != Settings::LOOKUP_RIGHT) &&
+                              (first == LEFT ? !settings.isRightOuter() : !settings.isLeftOuter());
+        size_t chunkFilterBits = 0;
+        if(filtered)
+        {
+            chunkFilterBits = first == LEFT ? ChunkFilter<LEFT> (settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()).getByteSize() * 8 :
+                                              ChunkFilter<RIGHT>(settings, inputArrays[0]->getArrayDesc(), inputArrays[1]->getArrayDesc()).getByteSize() * 8;
+        }
+        bool const bloom = filtered && algo != Settings::HASH_REPLICATE_LEFT && algo != Settings::HASH_REPLICATE_RIGHT;
+        vector<std::pair<string, string> > report;
+        report.push_back(std::make_pair("algorithm",                 string(algorithmName(algo))));
+        report.push_back(std::make_pair("algorithm_set",             string(settings.algorithmSet() ? "true" : "false")));
+        report.push_back(std::make_pair("instances",                 std::to_string(nInstances)));
+        report.push_back(std::make_pair("inputs_colocated",          string(colocated ? "true" : "false")));
+        report.push_back(std::make_pair("left_materialized",         string(plan.leftMaterialized  ? "true" : "false")));
+        report.push_back(std::make_pair("right_materialized",        string(plan.rightMaterialized ? "true" : "false")));
+        report.push_back(std::make_pair("left_single_pass",          string(inputArrays[0]->getSupportedAccess() == Array::SINGLE_PASS ? "true" : "false")));
+        report.push_back(std::make_pair("right_single_pass",         string(inputArrays[1]->getSupportedAccess() == Array::SINGLE_PASS ? "true" : "false")));
+        report.push_back(std::make_pair("left_local_cells",          inputArrays[0]->isMaterialized() ? std::to_string(countCells(inputArrays[0])) : string("unknown")));
+        report.push_back(std::make_pair("right_local_cells",         inputArrays[1]->isMaterialized() ? std::to_string(countCells(inputArrays[1])) : string("unknown")));
+        report.push_back(std::make_pair("left_scan_finished",        std::to_string(plan.leftFinished)  + "/" + std::to_string(nInstances)));
+        report.push_back(std::make_pair("right_scan_finished",       std::to_string(plan.rightFinished) + "/" + std::to_string(nInstances)));
+        report.push_back(std::make_pair("left_size_bytes",           std::to_string(plan.leftSizeLow)  + "-" + std::to_string(plan.leftSize)));
+        report.push_back(std::make_pair("right_size_bytes",          std::to_string(plan.rightSizeLow) + "-" + std::to_string(plan.rightSize)));
+        report.push_back(std::make_pair("hash_join_threshold_bytes", std::to_string(settings.getHashJoinThreshold())));
+        report.push_back(std::make_pair("memory_budget_bytes",       std::to_string(settings.getMemoryBudget().getLimit())));
+        report.push_back(std::make_pair("chunk_filter_bits",         std::to_string(chunkFilterBits)));
+        report.push_back(std::make_pair("bloom_filter_bits",         bloom ? std::to_string(settings.getBloomFilterSize()) + (settings.bloomFilterSizeSet() ? "" : " (before folding)") : string("0")));
+        report.push_back(std::make_pair("expected_shuffle_bytes",    (exact ? string("") : string(">=")) + std::to_string(shuffleBytes)));
+        ArrayWriter<WRITE_REPORT> output(settings, query, _schema);
+        vector<Value const*> tuple(2, NULL);
+        Value key, value;
+        tuple[0] = &key;
+        tuple[1] = &value;
+        for(size_t i=0; i<report.size(); ++i)
+        {
+            key.setString(report[i].first);
+            value.setString(report[i].second);
+            output.writeTuple(tuple);
+        }
+        return output.finalize();
+    }
+
+    /**
+     * firstReplicated: a copy of the whole first array already on every instance, if replicationHashJoin gave up.
+     */
+    template <Handedness WHICH_FIRST>
+    shared_ptr<Array> mergeJoin(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query, Settings const& settings,
+                                shared_ptr<Array> const& firstReplicated = shared_ptr<Array>())
+    {
+        if(settings.isLeftOuter() && settings.isRightOuter())
+        {
+            return globalMergeJoin<WHICH_FIRST, true, true>(inputArrays, query, settings, firstReplicated);
+        }
+        if(settings.isLeftOuter())
+        {
+            return globalMergeJoin<WHICH_FIRST, true, false>(inputArrays, query, settings, firstReplicated);
+        }
+        if(settings.isRightOuter())
+        {
+            return globalMergeJoin<WHICH_FIRST, false, true>(inputArrays, query, settings, firstReplicated);
+        }
+        return globalMergeJoin<WHICH_FIRST, false, false>(inputArrays, query, settings, firstReplicated);
+    }
+
+    /**
+     * profile:true - return, instead of the result of the join, the counters of every phase that ran on this instance.
+     */
+    shared_ptr<Array> profileReport(shared_ptr<Query>& query, Settings const& settings)
+    {
+        Profile const& profile = settings.getProfile();
+        ArrayWriter<WRITE_REPORT> output(settings, query, _schema);
+        vector<Value const*> tuple(7, NULL);
+        vector<Value> values(7);
+        for(size_t i=0; i<values.size(); ++i)
+        {
+            tuple[i] = &values[i];
+        }
+        for(size_t p=0; p<Profile::NUM_PHASES; ++p)
+        {
+            Profile::Phase const phase = static_cast<Profile::Phase>(p);
+            Profile::Counters const& counters = profile.getCounters(phase);
+            if(counters.runs == 0)
+            {
+                continue;
+            }
+            values[0].setString(Profile::getPhaseName(phase));
+            values[1].setUint64(counters.runs);
+            values[2].setDouble(counters.wallSeconds);
+            values[3].setDouble(counters.cpuSeconds);
+            values[4].setUint64(counters.rows);
+            values[5].setUint64(counters.bytes);
+            values[6].setUint64(counters.peakMemory);
+            output.writeTuple(tuple);
+        }
+        Profile::FilterCounters const& filters = profile.getFilters();
+        if(filters.bloomFilters)
+        {
+            writeCountRow(output, tuple, values, "bloom_filter_bits",     filters.bloomFilters, filters.bloomBits);
+            writeCountRow(output, tuple, values, "bloom_filter_bits_set", filters.bloomFilters, filters.bloomBitsSet);
+        }
+        if(filters.tuplesProbed)
+        {
+            writeCountRow(output, tuple, values, "bloom_filter_probed",   filters.scans, filters.tuplesProbed);
+            writeCountRow(output, tuple, values, "bloom_filter_excluded", filters.scans, filters.tuplesExcluded);
+        }
+        if(filters.bloomStopped)
+        {
+            writeCountRow(output, tuple, values, "bloom_filter_stopped",  filters.bloomStopped, 0);
+        }
+        if(filters.chunksProbed)
+        {
+            writeCountRow(output, tuple, values, "chunk_filter_probed",   filters.scans, filters.chunksProbed);
+            writeCountRow(output, tuple, values, "chunk_filter_excluded", filters.scans, filters.chunksExcluded);
+        }
+        HashTableShape const& tables = profile.getHashTables();
+        if(tables.getNumTables())
+        {
+            writeCountRow(output, tuple, values, "hash_table",        tables.getNumTables(), tables.getNumTuples(), tables.getBytes());
+            writeCountRow(output, tuple, values, "hash_keys",         tables.getNumTables(), tables.getNumKeys());
+            writeCountRow(output, tuple, values, "hash_buckets",      tables.getNumTables(), tables.getNumBuckets());
+            writeCountRow(output, tuple, values, "hash_used_buckets", tables.getNumTables(), tables.getUsedBuckets());
+            writeCountRow(output, tuple, values, "hash_max_chain",    tables.getNumTables(), tables.getMaxChain());
+            writeCountRow(output, tuple, values, "hash_max_run",      tables.getNumTables(), tables.getMaxRun());
+            for(size_t bin=0; bin<HashTableShape::NUM_BINS; ++bin)
+            {
+                if(tables.getChains(bin))
+                {
+                    writeCountRow(output, tuple, values, "hash_chain_" + HashTableShape::getBinName(bin), tables.getChains(bin), tables.getChainKeys(bin));
+                }
+            }
+            for(size_t bin=0; bin<HashTableShape::NUM_BINS; ++bin)
+            {
+                if(tables.getRuns(bin))
+                {
+                    writeCountRow(output, tuple, values, "hash_run_" + HashTableShape::getBinName(bin), tables.getRuns(bin), tables.getRunTuples(bin));
+                }
+            }
+        }
+        return output.finalize();
+    }
+
+    /**
+     * A profile row that counts something rather than timing a phase: a count in runs and another in rows, no times.
+     */
+    void writeCountRow(ArrayWriter<WRITE_REPORT>& output, vector<Value const*> const& tuple, vector<Value>& values, string const& name,
+                       size_t const runs, size_t const rows, size_t const bytes = 0)
+    {
+        values[0].setString(name);
+        values[1].setUint64(runs);
+        values[2].setDouble(0);
+        values[3].setDouble(0);
+        values[4].setUint64(rows);
+        values[5].setUint64(bytes);
+        values[6].setUint64(0);
+        output.writeTuple(tuple);
+    }
+
+    shared_ptr< Array> execute(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query> query) override
+    {
+        vector<ArrayDesc const*> inputSchemas(2);
+        inputSchemas[0] = &inputArrays[0]->getArrayDesc();
+        inputSchemas[1] = &inputArrays[1]->getArrayDesc();
+        LOG4CXX_DEBUG(logger, "execute - Checking attributes.");
+        Settings settings(inputSchemas, _parameters, _kwParameters, query);
+        if(settings.isExplain())
+        {
+            return explainPlan(inputArrays, query, settings);
+        }
+        _joinSchema = settings.isProfile() ? settings.getJoinSchema(query) : _schema;
+        shared_ptr<Array> result = join(inputArrays, query, settings);
+        settings.getProfile().logPhases();
+        if(settings.isProfile())
+        {
+            return profileReport(query, settings);
+        }
+        return result;
+    }
+
+    shared_ptr<Array> join(vector< shared_ptr< Array> >& inputArrays, shared_ptr<Query>& query, Settings const& settings)
+    {
+        Settings::algorithm algo;
+        PlanInfo plan;
+        {
+            PhaseTimer timer(settings.getProfile(), Profile::PRESCAN);
+            algo = pickAlgorithm(inputArrays, query, settings, plan);
+        }
+        if(algo == Settings::HASH_REPLICATE_LEFT)
+        {
+            bool const small = isSmallArray<LEFT>(plan, query, settings);
+            LOG4CXX_DEBUG(logger, "EJ running hash_replicate_left, small "<<small);
+            return replicationHashJoin<LEFT>(inputArrays, query, settings, small);
+        }
+        else if (algo == Settings::HASH_REPLICATE_RIGHT)
+        {
+            bool const small = isSmallArray<RIGHT>(plan, query, settings);
+            LOG4CXX_DEBUG(logger, "EJ running hash_replicate_right, small "<<small);
+            return replicationHashJoin<RIGHT>(inputArrays, query, settings, small);
+        }
+        else if (algo == Settings::MERGE_LEFT_FIRST)
+        {
+            LOG4CXX_DEBUG(logger, "EJ running merge_left_first");
+            return mergeJoin<LEFT>(inputArrays, query, settings);
+        }
+        else if (algo == Settings::ALIGNED_CHUNKS)
+        {
+            LOG4CXX_DEBUG(logger, "EJ running aligned chunks");
+            if(settings.isLeftOuter() && settings.isRightOuter())
+            {
+                return alignedChunkJoin<true, true>(inputArrays, query, settings);
+            }
+            if(settings.isLeftOuter())
+            {
+                return alignedChunkJoin<true, false>(inputArrays, query, settings);
+            }
+            if(settings.isRightOuter())
+            {
+                return alignedChunkJoin<false, true>(inputArrays, query, settings);
+            }
+            return alignedChunkJoin<false, false>(inputArrays, query, settings);
+        }
+        else if (algo == Settings::COLOCATED)
+        {
+            for(size_t i=0; i<2; ++i)
+            {
+                if(inputArrays[i]->getSupportedAccess() == Array::SINGLE_PASS)
+                {
+                    inputArrays[i] = ensureRandomAccess(inputArrays[i], query);
+                }
+            }
+            //a local decision: start with the smaller array on this instance
+            bool const leftFirst = computeArrayOverhead<LEFT>(inputArrays[0], query, settings) <= computeArrayOverhead<RIGHT>(inputArrays[1], query, settings);
+            LOG4CXX_DEBUG(logger, "EJ running colocated, left first "<<leftFirst);
+            if(settings.isLeftOuter() && settings.isRightOuter())
+            {
+                return leftFirst ? colocatedJoin<LEFT, true, true>(inputArrays, query, settings) : colocatedJoin<RIGHT, true, true>(inputArrays, query, settings);
+            }
+            if(settings.isLeftOuter())
+            {
+                return leftFirst ? colocatedJoin<LEFT, true, false>(inputArrays, query, settings) : colocatedJoin<RIGHT, true, false>(inputArrays, query, settings);
+            }
+            if(settings.isRightOuter())
+            {
+                return leftFirst ? colocatedJoin<LEFT, false, true>(inputArrays, query, settings) : colocatedJoin<RIGHT, false, true>(inputArrays, query, settings);
+            }
+            return leftFirst ? colocatedJoin<LEFT, false, false>(inputArrays, query, settings) : colocatedJoin<RIGHT, false, false>(inputArrays, query, settings);
+        }
+        else if (algo == Settings::LATE_LEFT_FIRST)
+        {
+            LOG4CXX_DEBUG(logger, "EJ running late_left_first");
+            return lateMaterializationJoin<LEFT>(inputArrays, query, settings);
+        }
+        else if (algo == Settings::LATE_RIGHT_FIRST)
+        {
+            LOG4CXX_DEBUG(logger, "EJ running late_right_first");
+            return lateMaterializationJoin<RIGHT>(inputArrays, query, settings);
+        }
+        else if (algo == Settings::LOOKUP_LEFT)
+        {
+            LOG4CXX_DEBUG(logger, "EJ running lookup_left");
+            return lookupJoin<LEFT>(inputArrays, query, settings);
+        }
+        else if (algo == Settings::LOOKUP_RIGHT)
+        {
+            LOG4CXX_DEBUG(logger, "EJ running lookup_right");
+            return lookupJoin<RIGHT>(inputArrays, query, settings);
+        }
+        else
+        {
+            LOG4CXX_DEBUG(logger, "EJ running merge_right_first");
+            return mergeJoin<RIGHT>(inputArrays, query, settings);
         }
     }
 };
@@ -0,0 +1,287 @@
+#!/bin/bash
+# End-to-end benchmarks of equi_join over synthetic inputs, against the SciDB that iquery connects to, with the
+# plugin loaded. Best run on a single host with several instances, with nothing else running.
+#
+# ./bench.sh [--outfile <file>] [--scale <factor>] [--repeat <count>] [--keep]
+#   --outfile : the CSV to write, bench.csv next to this script by default
+#   --scale   : multiplies the sizes of the inputs, 1M cells for the larger input by default
+#   --repeat  : how many times each join is timed; the median is kept. 3 by default
+#   --keep    : keep the generated arrays, named ej_bench_*, for another run
+#
+# ./bench.sh --compare <baseline.csv> <new.csv> [<tolerance>]
+#   prints the rows whose wall_seconds changed by more than the tolerance, 0.2 (20%) by default, or whose rows changed
+#
+# Each join is timed with consume(), then run once more with profile:true. The CSV has a row per case, algorithm and
+# phase: "total" for the timed runs, where rows are the output cells, then the phases of the profile added up over the
+# instances, but for wall_seconds and peak_memory_bytes, which are those of the slowest and the largest instance. The
+# rows on the shape of the hash tables follow; see Profile in the README.
+# A join that fails, like a lookup without dimension keys, is recorded with the phase "error".
+
+MYDIR=`dirname $0`
+pushd $MYDIR > /dev/null
+MYDIR=`pwd`
+source $MYDIR/bench_data.sh
+set -o pipefail
+
+PHASES="prescan filter_exchange split tupling sort redistribute build probe write"
+BINS="1 2 3_4 5_8 9_16 17_32 33_64 65_plus"
+FILTER_ROWS="bloom_filter_bits bloom_filter_bits_set bloom_filter_probed bloom_filter_excluded bloom_filter_stopped chunk_filter_probed chunk_filter_excluded"
+HASH_ROWS="hash_table hash_keys hash_buckets hash_used_buckets hash_max_chain hash_max_run `for b in $BINS; do echo -n "hash_chain_$b "; done``for b in $BINS; do echo -n "hash_run_$b "; done`"
+HEADER="case,algorithm,phase,runs,wall_seconds,cpu_seconds,rows,bytes,peak_memory_bytes"
+
+compare () {
+    local tolerance=${3:-0.2}
+    awk -F, -v tolerance=$tolerance '
+        NR == FNR { if (FNR > 1) { wall[$1 "," $2 "," $3] = $5; rows[$1 "," $2 "," $3] = $7 } next }
+        FNR == 1  { print "case,algorithm,phase,baseline_wall_seconds,wall_seconds,ratio,baseline_rows,rows"; next }
+        {
+            key = $1 "," $2 "," $3
+            if (!(key in wall)) { print key ",," $5 ",,," $7; next }
+            ratio = wall[key] > 0 ? $5 / wall[key] : 0
+            # times under 10ms are noise
+            slower = $5 > 0.01 && ratio > 1 + tolerance
+            faster = wall[key] > 0.01 && ratio < 1 / (1 + tolerance)
+            if (slower || faster || rows[key] != $7) {
+                printf "%s,%s,%s,%.2f,%s,%s\n", key, wall[key], $5, ratio, rows[key], $7
+            }
+            delete wall[key]
+        }
+        END { for (key in wall) print key "," wall[key] ",,," rows[key] "," }' "$1" "$2"
+}
+
+if [ "$1" = "--compare" ]; then
+    if [ $# -lt 3 ]; then
+        echo "usage: $0 --compare <baseline.csv> <new.csv> [<tolerance>]" >&2
+        exit 1
+    fi
+    popd > /dev/null
+    compare "$2" "$3" "$4"
+    exit 0
+fi
+
+OUTFILE=$MYDIR/bench.csv
+SCALE=1
+REPEAT=3
+KEEP=0
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --outfile) OUTFILE="$2"; shift 2 ;;
+        --scale)   SCALE="$2";   shift 2 ;;
+        --repeat)  REPEAT="$2";  shift 2 ;;
+        --keep)    KEEP=1;       shift ;;
+        *)         echo "unknown option $1" >&2; exit 1 ;;
+    esac
+done
+
+ARRAYS=""
+ERRFILE=`mktemp`
+trap "rm -f $ERRFILE" EXIT
+
+# <cells> : the cells scaled by --scale, at least 1
+scaled () {
+    awk -v cells=$1 -v scale=$SCALE 'BEGIN { n = int(cells * scale); print (n < 1 ? 1 : n) }'
+}
+
+# Stores the array once for this run, named in KEYED_ARRAY
+# <cells> <distinct_keys> <skew> <key_type> [<first_key>]
+keyed_array () {
+    KEYED_ARRAY="ej_bench_${4}_${1}_${2}_${3//./p}_${5:-0}"
+    if [[ " $ARRAYS " != *" $KEYED_ARRAY "* ]]; then
+        echo "generating $KEYED_ARRAY" >&2
+        make_keyed_array $KEYED_ARRAY "$@" > /dev/null || exit 1
+        ARRAYS="$ARRAYS $KEYED_ARRAY"
+    fi
+}
+
+# Stores the build and probe sides of a case, named in LEFT and RIGHT
+# <left_cells> <right_cells> <distinct_keys> <skew> <key_type> [<right_first_key>]
+keyed_arrays () {
+    keyed_array $1 $3 $4 $5
+    LEFT=$KEYED_ARRAY
+    keyed_array $2 $3 $4 $5 $6
+    RIGHT=$KEYED_ARRAY
+}
+
+# Prints the median time in seconds of running the query --repeat times, or fails with the error in ERRFILE
+time_query () {
+    local times=""
+    local r start end
+    for r in `seq $REPEAT`; do
+        start=`date +%s.%N`
+        iquery -anq "$1" > /dev/null 2> $ERRFILE || return 1
+        end=`date +%s.%N`
+        times="$times `awk -v start=$start -v end=$end 'BEGIN { printf "%.3f", end - start }'`"
+    done
+    echo $times | tr ' ' '\n' | sort -g | awk '{ t[NR] = $1 } END { print t[int((NR + 1) / 2)] }'
+}
+
+# Adds up the profile:true output of all instances into a CSV row per phase, in the order of PHASES, then the rows
+# about the filters and the hash tables; the maximum chain and run are the largest of any instance
+add_up_profile () {
+    awk -F, -v bench_case="$1" -v algorithm="$2" -v phases="$PHASES $FILTER_ROWS $HASH_ROWS" '
+        NR > 1 {
+            gsub("\047", "", $1)
+            runs[$1] += $2; cpu[$1] += $4; bytes[$1] += $6
+            if ($1 ~ /^hash_max_/) { if ($5 > rows[$1]) rows[$1] = $5 } else rows[$1] += $5
+            if ($3 > wall[$1]) wall[$1] = $3
+            if ($7 > peak[$1]) peak[$1] = $7
+        }
+        END {
+            n = split(phases, order, " ")
+            for (i = 1; i <= n; ++i) {
+                p = order[i]
+                if (p in runs) {
+                    printf "%s,%s,%s,%d,%.3f,%.3f,%d,%d,%d\n", bench_case, algorithm, p, runs[p], wall[p], cpu[p], rows[p], bytes[p], peak[p]
+                }
+            }
+        }'
+}
+
+log_error () {
+    echo "$1,$2,error,,,,,," >> $OUTFILE
+    echo "  $2 failed: `grep -m1 -i error $ERRFILE`" >&2
+}
+
+# Times equi_join(<left>, <right>, <settings>[, algorithm:<algorithm>]) for each algorithm, where auto leaves the pick
+# to the operator, and records it with its profile
+# <case> <left> <right> <settings> <algorithms...>
+run_join () {
+    local bench_case=$1
+    local left=$2
+    local right=$3
+    local settings=$4
+    shift 4
+    local algorithm query seconds profile
+    echo "$bench_case" >&2
+    for algorithm in "$@"; do
+        query="equi_join($left, $right, $settings"
+        if [ "$algorithm" != "auto" ]; then
+            query="$query, algorithm:'$algorithm'"
+        fi
+        if ! seconds=`time_query "consume($query))"`; then
+            log_error $bench_case $algorithm
+            continue
+        fi
+        if ! profile=`iquery -ocsv:l -aq "$query, profile:true)" 2> $ERRFILE | add_up_profile $bench_case $algorithm`; then
+            log_error $bench_case $algorithm
+            continue
+        fi
+        local output_rows=`echo "$profile" | awk -F, '$3 == "write" { print $7 }'`
+        echo "$bench_case,$algorithm,total,$REPEAT,$seconds,,$output_rows,," >> $OUTFILE
+        echo "$profile" >> $OUTFILE
+        echo "  $algorithm: ${seconds}s" >&2
+    done
+}
+
+# Times a query that isn't an equi_join, for comparison
+# <case> <name> <query>
+run_other () {
+    local seconds
+    if ! seconds=`time_query "consume($3)"`; then
+        log_error $1 $2
+        return
+    fi
+    local output_rows=`iquery -ocsv -aq "op_count($3)" 2> $ERRFILE | tail -n 1`
+    echo "$1,$2,total,$REPEAT,$seconds,,$output_rows,," >> $OUTFILE
+    echo "  $2: ${seconds}s" >&2
+}
+
+INNER="auto hash_replicate_left hash_replicate_right merge_left_first merge_right_first late_left_first late_right_first"
+OUTER="auto hash_replicate_left hash_replicate_right merge_left_first merge_right_first"
+N=`scaled 1000000`
+
+echo "$HEADER" > $OUTFILE
+
+# Build side sizes, against a probe side of N cells; the build side draws from as many keys as it has cells
+for cells in $((N / 100)) $((N / 10)) $N; do
+    [ $cells -gt 0 ] || continue
+    keyed_arrays $cells $N $cells 0 int64
+    run_join size_${cells}_x_${N} $LEFT $RIGHT "left_ids:0, right_ids:0" $INNER
+done
+
+# Key types
+for key_type in double string long_string int64_string; do
+    ids=`key_ids $key_type`
+    keyed_arrays $((N / 10)) $N $((N / 10)) 0 $key_type
+    run_join key_$key_type $LEFT $RIGHT "left_ids:$ids, right_ids:$ids" $INNER
+done
+
+# Multiplicity: N cells on both sides, with fewer and fewer distinct keys; the output grows as N * N / distinct
+for distinct in $N $((N / 10)) $((N / 100)); do
+    [ $distinct -gt 0 ] || continue
+    keyed_arrays $N $N $distinct 0 int64
+    run_join multiplicity_$((N / distinct)) $LEFT $RIGHT "left_ids:0, right_ids:0" $INNER
+done
+
+# Skew: the same number of distinct keys, with more and more of the cells on the first ones
+for skew in 0 2 3; do
+    keyed_arrays $((N / 10)) $N $((N / 10)) $skew int64
+    run_join skew_$skew $LEFT $RIGHT "left_ids:0, right_ids:0" $INNER
+done
+run_join skew_3_handled $LEFT $RIGHT "left_ids:0, right_ids:0, skew_handling:true" merge_left_first merge_right_first
+
+# Match rate: the share of probe keys that are in the build side
+for percent in 100 10 1; do
+    distinct=$((N / 10))
+    keyed_arrays $distinct $N $distinct 0 int64 $((distinct - distinct * percent / 100))
+    run_join match_${percent}pct $LEFT $RIGHT "left_ids:0, right_ids:0" $INNER
+done
+
+# Outer joins, with half of the keys matching on either side
+for outer in left_outer right_outer full_outer; do
+    distinct=$((N / 10))
+    case $outer in
+        left_outer)  settings="left_outer:true" ;;
+        right_outer) settings="right_outer:true" ;;
+        full_outer)  settings="left_outer:true, right_outer:true" ;;
+    esac
+    keyed_arrays $distinct $N $distinct 0 int64 $((distinct / 2))
+    run_join $outer $LEFT $RIGHT "left_ids:0, right_ids:0, $settings" $OUTER
+done
+
+# Keys of a small array against the dimension of a large one, the case for lookup_left
+echo "generating ej_bench_dimension" >&2
+make_dimension_array ej_bench_dimension $N > /dev/null || exit 1
+ARRAYS="$ARRAYS ej_bench_dimension"
+keyed_array $((N / 100)) $N 0 int64
+run_join dimension_lookup $KEYED_ARRAY ej_bench_dimension "left_ids:0, right_ids:-1" $INNER lookup_left
+
+# The README comparison with cross_join: a strip of a 2D array, selected by a dimension
+side=`awk -v cells=$((4 * N)) 'BEGIN { print int(sqrt(cells)) }'`
+echo "generating ej_bench_twod" >&2
+iquery -anq "remove(ej_bench_twod)" > /dev/null 2>&1
+iquery -anq "store(build(<a:double>[x=1:$side,1000,0, y=1:$side,1000,0], random()), ej_bench_twod)" || exit 1
+ARRAYS="$ARRAYS ej_bench_twod"
+strip=$(( side < 128 ? side : 128 ))
+echo "strip" >&2
+run_other strip cross_join "cross_join(ej_bench_twod as A, redimension(build(<x:int64>[i=0:0,1,0], $strip), <i:int64>[x=1:$side,1000,0]) as B, A.x, B.x)"
+run_join strip "ej_bench_twod as A" "build(<x:int64>[i=0:0,1,0], $strip) as B" "left_names:A.x, right_names:B.x" $INNER
+
+# The range join of equi_range_join.R: short intervals against long ones on the same chromosomes, each interval in the
+# one or two buckets it overlaps, joined on the chromosome and the bucket; the filter keeps the overlaps once.
+variants=`scaled 1000000`
+genes=$(( variants / 50 > 0 ? variants / 50 : 1 ))
+bucket=100001
+echo "generating ej_bench_variant and ej_bench_gene" >&2
+make_interval_array ej_bench_variant variant $variants 10 10000000 > /dev/null || exit 1
+make_interval_array ej_bench_gene gene $genes $((bucket - 1)) 10000000 > /dev/null || exit 1
+ARRAYS="$ARRAYS ej_bench_variant ej_bench_gene"
+bucketed () {
+    echo "project(
+           apply(cross_join($1, build(<f:bool>[offset=0:1,2,0], true)),
+                 bucket, iif(offset = 0, ${2}_start / $bucket, iif(${2}_end / $bucket <> ${2}_start / $bucket, ${2}_end / $bucket, null))),
+           chromosome_id, bucket, ${2}_start, ${2}_end$3)"
+}
+run_join range "$(bucketed ej_bench_variant variant)" "$(bucketed ej_bench_gene gene ', v')" \
+         "left_names:(chromosome_id, bucket), right_names:(chromosome_id, bucket),
+          filter:'variant_start <= gene_end and gene_start <= variant_end and
+                  (variant_start / $bucket = variant_end / $bucket or gene_start / $bucket = gene_end / $bucket or variant_start / $bucket = bucket)'" \
+         $INNER
+
+if [ $KEEP -eq 0 ]; then
+    for name in $ARRAYS; do
+        iquery -anq "remove($name)" > /dev/null 2>&1
+    done
+fi
+echo "wrote $OUTFILE" >&2
+popd > /dev/null
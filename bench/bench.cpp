@@ -0,0 +1,616 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2016 SciDB, Inc.
+* All Rights Reserved.
+*
+* equi_join is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* equi_join is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* equi_join is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with equi_join.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * Microbenchmarks of the in-memory structures of equi_join, built against the shim in bench/shim instead of SciDB:
+ *
+ *   make bench
+ *   ./bench/equi_join_bench [build_tuples [probe_tuples [distinct_keys]]]
+ *
+ * For every key shape and distribution, build tuples are drawn from distinct_keys keys and probe tuples from twice
+ * as many, so about half the probes of a uniform workload miss. Zipf draws follow ranks with exponent 1.1, the most
+ * frequent keys being in the build range. "find" positions at the first match only, so the skewed workloads time the
+ * lookups rather than the size of their output. Each operation is timed over all the tuples, and reports hardware counters
+ * per tuple when the kernel allows perf_event_open (see /proc/sys/kernel/perf_event_paranoid); "-" otherwise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ArrayIO.h"
+
+using namespace scidb;
+using namespace scidb::equi_join;
+
+namespace
+{
+
+/**
+ * Hardware counters of this thread, each opened on its own so that whichever the CPU or the kernel allows are kept.
+ */
+class PerfCounters : public boost::noncopyable
+{
+public:
+    enum Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        NUM_COUNTERS
+    };
+
+private:
+    int      _fds[NUM_COUNTERS];
+    uint64_t _values[NUM_COUNTERS];
+
+    static int open(uint64_t const config)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+public:
+    PerfCounters()
+    {
+        uint64_t const configs[NUM_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                 PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        for(size_t i=0; i<NUM_COUNTERS; ++i)
+        {
+            _fds[i] = open(configs[i]);
+            _values[i] = 0;
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for(size_t i=0; i<NUM_COUNTERS; ++i)
+        {
+            if(_fds[i] >= 0)
+            {
+                close(_fds[i]);
+            }
+        }
+    }
+
+    void start()
+    {
+        for(size_t i=0; i<NUM_COUNTERS; ++i)
+        {
+            if(_fds[i] >= 0)
+            {
+                ioctl(_fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void stop()
+    {
+        for(size_t i=0; i<NUM_COUNTERS; ++i)
+        {
+            if(_fds[i] >= 0)
+            {
+                ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                if(read(_fds[i], &_values[i], sizeof(uint64_t)) != sizeof(uint64_t))
+                {
+                    _values[i] = 0;
+                }
+            }
+        }
+    }
+
+    bool has(Counter const counter) const
+    {
+        return _fds[counter] >= 0;
+    }
+
+    uint64_t get(Counter const counter) const
+    {
+        return _values[counter];
+    }
+};
+
+enum KeyShape
+{
+    INT64_KEY,
+    DOUBLE_KEY,
+    SHORT_STRING_KEY,   //fits in a Value
+    LONG_STRING_KEY,    //allocated
+    INT64_STRING_KEYS   //two keys
+};
+
+enum Distribution
+{
+    UNIFORM,
+    ZIPF
+};
+
+char const* shapeName(KeyShape const shape)
+{
+    switch(shape)
+    {
+    case INT64_KEY:         return "int64";
+    case DOUBLE_KEY:        return "double";
+    case SHORT_STRING_KEY:  return "short_string";
+    case LONG_STRING_KEY:   return "long_string";
+    case INT64_STRING_KEYS: return "int64+string";
+    }
+    return "unknown";
+}
+
+/**
+ * Draws ranks in [0, n), uniformly or with P(rank) proportional to 1/(rank+1)^exponent.
+ */
+class RankGenerator
+{
+private:
+    std::mt19937_64                  _rng;
+    Distribution const               _distribution;
+    size_t const                     _n;
+    vector<double>                   _cdf;
+    std::uniform_real_distribution<> _unit;
+
+public:
+    RankGenerator(Distribution const distribution, size_t const n, uint64_t const seed, double const exponent = 1.1):
+        _rng(seed),
+        _distribution(distribution),
+        _n(n),
+        _unit(0.0, 1.0)
+    {
+        if(distribution == ZIPF)
+        {
+            _cdf.resize(n);
+            double sum = 0;
+            for(size_t i=0; i<n; ++i)
+            {
+                sum += 1.0 / std::pow(static_cast<double>(i + 1), exponent);
+                _cdf[i] = sum;
+            }
+            for(size_t i=0; i<n; ++i)
+            {
+                _cdf[i] /= sum;
+            }
+        }
+    }
+
+    size_t next()
+    {
+        if(_distribution == UNIFORM)
+        {
+            return _rng() % _n;
+        }
+        size_t const rank = std::lower_bound(_cdf.begin(), _cdf.end(), _unit(_rng)) - _cdf.begin();
+        return std::min(rank, _n - 1);
+    }
+};
+
+/**
+ * Tuples as the operator makes them: the keys, then one int64 attribute, stored back to back.
+ */
+class TupleSet
+{
+private:
+    size_t const  _tupleSize;
+    vector<Value> _values;
+
+public:
+    TupleSet(size_t const tupleSize):
+        _tupleSize(tupleSize)
+    {}
+
+    void add(KeyShape const shape, size_t const rank)
+    {
+        Value key;
+        switch(shape)
+        {
+        case INT64_KEY:
+            key.setInt64(static_cast<int64_t>(rank));
+            _values.push_back(key);
+            break;
+        case DOUBLE_KEY:
+            key.setDouble(rank * 0.5 + 0.25);
+            _values.push_back(key);
+            break;
+        case SHORT_STRING_KEY:
+            key.setString("k" + std::to_string(rank));
+            _values.push_back(key);
+            break;
+        case LONG_STRING_KEY:
+        {
+            string digits = std::to_string(rank);
+            key.setString("key-" + string(40 - digits.size(), '0') + digits);
+            _values.push_back(key);
+            break;
+        }
+        case INT64_STRING_KEYS:
+            key.setInt64(static_cast<int64_t>(rank / 64));
+            _values.push_back(key);
+            key.setString("k" + std::to_string(rank % 64));
+            _values.push_back(key);
+            break;
+        }
+        Value payload;
+        payload.setInt64(static_cast<int64_t>(rank) * 7);
+        _values.push_back(payload);
+    }
+
+    size_t size() const
+    {
+        return _values.size() / _tupleSize;
+    }
+
+    void get(size_t const t, vector<Value const*>& tuple) const
+    {
+        for(size_t i=0; i<_tupleSize; ++i)
+        {
+            tuple[i] = &_values[t * _tupleSize + i];
+        }
+    }
+};
+
+shared_ptr<Expression> makeConstant(int64_t const value)
+{
+    Value v;
+    v.setInt64(value);
+    return std::make_shared<Expression>(v);
+}
+
+/**
+ * The settings for joining two arrays with the given keys as their first attributes, and an int64 attribute after.
+ * With rightDimensionKey, the right array has the single int64 key as its dimension instead, for the chunk filter.
+ */
+class BenchJoin
+{
+private:
+    shared_ptr<Query> _query;
+    ArrayDesc         _left;
+    ArrayDesc         _right;
+    shared_ptr<Settings> _settings;
+
+    static ArrayDesc makeSchema(char const* name, vector<TypeId> const& keyTypes, bool const keyIsDimension)
+    {
+        Attributes attributes;
+        if(!keyIsDimension)
+        {
+            for(size_t i=0; i<keyTypes.size(); ++i)
+            {
+                attributes.push_back(AttributeDesc("k" + std::to_string(i), keyTypes[i], 0, CompressorType::NONE));
+            }
+        }
+        attributes.push_back(AttributeDesc("v", TID_INT64, 0, CompressorType::NONE));
+        attributes.addEmptyTagAttribute();
+        Dimensions dimensions;
+        dimensions.push_back(DimensionDesc(keyIsDimension ? "k0" : "i", 0, CoordinateBounds::getMax(), 10000, 0));
+        return ArrayDesc(name, attributes, dimensions, createDistribution(dtHashPartitioned), ArrayResPtr());
+    }
+
+    static Parameter makeIds(size_t const numKeys, bool const keyIsDimension)
+    {
+        if(keyIsDimension)
+        {
+            return std::make_shared<OperatorParamPhysicalExpression>(makeConstant(-1));
+        }
+        shared_ptr<OperatorParamNested> ids = std::make_shared<OperatorParamNested>();
+        for(size_t i=0; i<numKeys; ++i)
+        {
+            ids->getParameters().push_back(std::make_shared<OperatorParamPhysicalExpression>(makeConstant(static_cast<int64_t>(i))));
+        }
+        return ids;
+    }
+
+public:
+    BenchJoin(vector<TypeId> const& keyTypes, bool const rightDimensionKey = false):
+        _query(std::make_shared<Query>()),
+        _left (makeSchema("left",  keyTypes, false)),
+        _right(makeSchema("right", keyTypes, rightDimensionKey))
+    {
+        vector<ArrayDesc const*> schemas;
+        schemas.push_back(&_left);
+        schemas.push_back(&_right);
+        KeywordParameters kwParams;
+        kwParams[KW_LEFT_IDS]  = makeIds(keyTypes.size(), false);
+        kwParams[KW_RIGHT_IDS] = makeIds(keyTypes.size(), rightDimensionKey);
+        _settings.reset(new Settings(schemas, Parameters(), kwParams, _query));
+    }
+
+    Settings const& getSettings() const
+    {
+        return *_settings;
+    }
+
+    ArrayDesc const& getLeft() const
+    {
+        return _left;
+    }
+
+    ArrayDesc const& getRight() const
+    {
+        return _right;
+    }
+};
+
+vector<TypeId> keyTypes(KeyShape const shape)
+{
+    vector<TypeId> types;
+    switch(shape)
+    {
+    case INT64_KEY:         types.push_back(TID_INT64);  break;
+    case DOUBLE_KEY:        types.push_back(TID_DOUBLE); break;
+    case SHORT_STRING_KEY:  types.push_back(TID_STRING); break;
+    case LONG_STRING_KEY:   types.push_back(TID_STRING); break;
+    case INT64_STRING_KEYS: types.push_back(TID_INT64);  types.push_back(TID_STRING); break;
+    }
+    return types;
+}
+
+/**
+ * Times one operation over n tuples and prints a row of the report.
+ */
+class Measurement
+{
+private:
+    PerfCounters&                          _counters;
+    string const                           _workload;
+    string const                           _op;
+    size_t const                           _n;
+    std::chrono::steady_clock::time_point  _start;
+
+    static void printPerTuple(PerfCounters const& counters, PerfCounters::Counter const counter, size_t const n)
+    {
+        if(counters.has(counter))
+        {
+            printf(" %9.2f", static_cast<double>(counters.get(counter)) / n);
+        }
+        else
+        {
+            printf(" %9s", "-");
+        }
+    }
+
+public:
+    Measurement(PerfCounters& counters, string const& workload, string const& op, size_t const n):
+        _counters(counters),
+        _workload(workload),
+        _op(op),
+        _n(n)
+    {
+        _counters.start();
+        _start = std::chrono::steady_clock::now();
+    }
+
+    void done(string const& note)
+    {
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+        _counters.stop();
+        printf("%-24s %-10s %10zu %9.1f %9.2f", _workload.c_str(), _op.c_str(), _n, seconds * 1e9 / _n, _n / seconds / 1e6);
+        printPerTuple(_counters, PerfCounters::CYCLES,        _n);
+        printPerTuple(_counters, PerfCounters::INSTRUCTIONS,  _n);
+        printPerTuple(_counters, PerfCounters::CACHE_MISSES,  _n);
+        printPerTuple(_counters, PerfCounters::BRANCH_MISSES, _n);
+        printf("  %s\n", note.c_str());
+        fflush(stdout);
+    }
+
+    static void printHeader()
+    {
+        printf("%-24s %-10s %10s %9s %9s %9s %9s %9s %9s  %s\n", "workload", "op", "tuples", "ns/tuple", "Mtuple/s",
+               "cycles", "instr", "llc_miss", "br_miss", "note");
+    }
+};
+
+void runWorkload(PerfCounters& counters, KeyShape const shape, Distribution const distribution,
+                 size_t const numBuild, size_t const numProbe, size_t const numDistinct)
+{
+    string const workload = string(shapeName(shape)) + (distribution == UNIFORM ? "/uniform" : "/zipf");
+    BenchJoin join(keyTypes(shape));
+    Settings const& settings = join.getSettings();
+    size_t const numKeys   = settings.getNumKeys();
+    size_t const tupleSize = settings.getLeftTupleSize();
+    TupleSet build(tupleSize);
+    TupleSet probe(tupleSize);
+    {
+        RankGenerator buildRanks(distribution, numDistinct, 1);
+        for(size_t i=0; i<numBuild; ++i)
+        {
+            build.add(shape, buildRanks.next());
+        }
+        RankGenerator probeRanks(distribution, 2 * numDistinct, 2);
+        for(size_t i=0; i<numProbe; ++i)
+        {
+            probe.add(shape, probeRanks.next());
+        }
+    }
+    vector<Value const*> tuple(tupleSize, NULL);
+    vector<char> hashBuf(64);
+    HyperLogLog sketch;
+    {
+        Measurement m(counters, workload, "hash", numBuild);
+        for(size_t t=0; t<numBuild; ++t)
+        {
+            build.get(t, tuple);
+            sketch.addHash(JoinHashTable::hashKeys(tuple, numKeys, hashBuf));
+        }
+        m.done("distinct~" + std::to_string(sketch.estimate()));
+    }
+    ArenaPtr arena(newArena(Options("equi_join_bench").resetting(true).threading(false).pagesize(8 * 1024 * 1024)));
+    JoinHashTable table(settings, arena, tupleSize);
+    {
+        Measurement m(counters, workload, "insert", numBuild);
+        for(size_t t=0; t<numBuild; ++t)
+        {
+            build.get(t, tuple);
+            table.insert(tuple);
+        }
+        m.done("bytes=" + std::to_string(table.usedBytes()));
+    }
+    {
+        HashTableShape const shape = table.getShape();
+        char note[256];
+        snprintf(note, sizeof(note), "buckets=%zu load=%.2f mean_chain=%.2f (uniform %.2f) max_chain=%zu max_run=%zu%s",
+                 shape.getNumBuckets(), shape.getLoadFactor(), shape.getMeanChain(), shape.getExpectedMeanChain(),
+                 shape.getMaxChain(), shape.getMaxRun(), shape.isDegraded() ? " DEGRADED" : "");
+        printf("%-24s %-10s %s\n", workload.c_str(), "shape", note);
+    }
+    {
+        JoinHashTable::const_iterator iter = table.getIterator();
+        size_t hits = 0;
+        Measurement m(counters, workload, "find", numProbe);
+        for(size_t t=0; t<numProbe; ++t)
+        {
+            probe.get(t, tuple);
+            iter.find(tuple);
+            hits += !iter.end() && iter.atKeys(tuple);
+        }
+        m.done("hits=" + std::to_string(hits));
+    }
+    BloomFilter bloom(settings.getBloomFilterSize());
+    {
+        Measurement m(counters, workload, "bloom_add", numBuild);
+        for(size_t t=0; t<numBuild; ++t)
+        {
+            build.get(t, tuple);
+            bloom.addTuple(tuple, numKeys);
+        }
+        m.done("bits=" + std::to_string(bloom.getBitSize()));
+    }
+    bloom.fold(std::max<size_t>(sketch.estimate() * 16, 1024)); //as the merge join does
+    {
+        size_t passed = 0;
+        Measurement m(counters, workload, "bloom_has", numProbe);
+        for(size_t t=0; t<numProbe; ++t)
+        {
+            probe.get(t, tuple);
+            passed += bloom.hasTuple(tuple, numKeys);
+        }
+        m.done("bits=" + std::to_string(bloom.getBitSize()) + " passed=" + std::to_string(passed));
+    }
+}
+
+/**
+ * The chunk filter made from the int64 keys of the left array, checked against the chunks of a right array that
+ * has that key as its dimension, one chunk position per probe tuple.
+ */
+void runChunkFilter(PerfCounters& counters, Distribution const distribution, size_t const numBuild, size_t const numProbe,
+                    size_t const numDistinct)
+{
+    string const workload = string("int64_dimension") + (distribution == UNIFORM ? "/uniform" : "/zipf");
+    BenchJoin join(keyTypes(INT64_KEY), true);
+    Settings const& settings = join.getSettings();
+    size_t const tupleSize = settings.getLeftTupleSize();
+    TupleSet build(tupleSize);
+    vector<Coordinates> chunks(numProbe, Coordinates(1));
+    {
+        RankGenerator buildRanks(distribution, numDistinct, 1);
+        for(size_t i=0; i<numBuild; ++i)
+        {
+            build.add(INT64_KEY, buildRanks.next());
+        }
+        int64_t const interval = join.getRight().getDimensions()[0].getChunkInterval();
+        RankGenerator probeRanks(distribution, 2 * numDistinct, 2);
+        for(size_t i=0; i<numProbe; ++i)
+        {
+            chunks[i][0] = static_cast<Coordinate>(probeRanks.next()) / interval * interval;
+        }
+    }
+    vector<Value const*> tuple(tupleSize, NULL);
+    ChunkFilter<LEFT> filter(settings, join.getLeft(), join.getRight());
+    {
+        Measurement m(counters, workload, "chunk_add", numBuild);
+        for(size_t t=0; t<numBuild; ++t)
+        {
+            build.get(t, tuple);
+            filter.addTuple(tuple);
+        }
+        m.done("bytes=" + std::to_string(filter.getByteSize()));
+    }
+    {
+        size_t passed = 0;
+        Measurement m(counters, workload, "chunk_has", numProbe);
+        for(size_t t=0; t<numProbe; ++t)
+        {
+            passed += filter.containsChunk(chunks[t]);
+        }
+        m.done("passed=" + std::to_string(passed));
+    }
+}
+
+size_t parseCount(char const* arg, char const* what)
+{
+    char* end = NULL;
+    unsigned long long const n = strtoull(arg, &end, 10);
+    if(end == arg || *end != '\0' || n == 0)
+    {
+        fprintf(stderr, "invalid %s '%s'\n", what, arg);
+        exit(1);
+    }
+    return static_cast<size_t>(n);
+}
+
+} //namespace
+
+int main(int argc, char** argv)
+{
+    size_t const numBuild    = argc > 1 ? parseCount(argv[1], "build_tuples")  : 1000000;
+    size_t const numProbe    = argc > 2 ? parseCount(argv[2], "probe_tuples")  : 1000000;
+    size_t const numDistinct = argc > 3 ? parseCount(argv[3], "distinct_keys") : 250000;
+    PerfCounters counters;
+    printf("build %zu probe %zu distinct %zu; hardware counters are per tuple\n", numBuild, numProbe, numDistinct);
+    Measurement::printHeader();
+    try
+    {
+        KeyShape const shapes[] = { INT64_KEY, DOUBLE_KEY, SHORT_STRING_KEY, LONG_STRING_KEY, INT64_STRING_KEYS };
+        Distribution const distributions[] = { UNIFORM, ZIPF };
+        for(Distribution const distribution : distributions)
+        {
+            for(KeyShape const shape : shapes)
+            {
+                runWorkload(counters, shape, distribution, numBuild, numProbe, numDistinct);
+            }
+            runChunkFilter(counters, distribution, numBuild, numProbe, numDistinct);
+        }
+    }
+    catch(std::exception const& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,2 @@
+//SciDB header, for the benchmarks: see scidb_shim.h
+#include "scidb_shim.h"
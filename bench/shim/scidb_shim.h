@@ -0,0 +1,1415 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2016 SciDB, Inc.
+* All Rights Reserved.
+*
+* equi_join is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* equi_join is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* equi_join is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with equi_join.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+/*
+ * Just enough of the SciDB API to build the in-memory structures of equi_join - JoinHashTable, BloomFilter,
+ * ChunkFilter, HyperLogLog - outside of SciDB, for the microbenchmarks in bench/. What they use on the hot path
+ * behaves like SciDB: Value keeps up to 8 bytes inline and allocates the rest, the arena allocates in pages. The
+ * query is a single instance. Anything the benchmarks don't reach - arrays, networking, expressions - is declared
+ * so the headers compile, and throws if called.
+ */
+#ifndef EQUI_JOIN_BENCH_SCIDB_SHIM_H
+#define EQUI_JOIN_BENCH_SCIDB_SHIM_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/any.hpp>
+#include <boost/noncopyable.hpp>
+
+//the operator's debug logging compiles, but never runs
+#define LOG4CXX_TRACE(l, m) { if(false) { std::ostringstream _shimLog; _shimLog << m; } }
+#define LOG4CXX_DEBUG(l, m) { if(false) { std::ostringstream _shimLog; _shimLog << m; } }
+#define LOG4CXX_INFO(l, m)  { if(false) { std::ostringstream _shimLog; _shimLog << m; } }
+#define LOG4CXX_WARN(l, m)  { std::ostringstream _shimLog; _shimLog << m; std::cerr << _shimLog.str() << std::endl; }
+#define LOG4CXX_ERROR(l, m) { std::ostringstream _shimLog; _shimLog << m; std::cerr << _shimLog.str() << std::endl; }
+
+namespace log4cxx
+{
+struct Logger
+{
+    static std::shared_ptr<Logger> getLogger(char const*)
+    {
+        return std::make_shared<Logger>();
+    }
+};
+typedef std::shared_ptr<Logger> LoggerPtr;
+}
+
+#define SCIDB_ASSERT(x) assert(x)
+#define SCIDB_CODE_LOC __FILE__
+
+namespace scidb
+{
+
+typedef int64_t                 Coordinate;
+typedef std::vector<Coordinate> Coordinates;
+typedef uint64_t                InstanceID;
+typedef uint32_t                AttributeID;
+typedef std::string             TypeId;
+
+static TypeId const TID_BOOL   = "bool";
+static TypeId const TID_INT32  = "int32";
+static TypeId const TID_INT64  = "int64";
+static TypeId const TID_UINT32 = "uint32";
+static TypeId const TID_UINT64 = "uint64";
+static TypeId const TID_DOUBLE = "double";
+static TypeId const TID_STRING = "string";
+
+class SystemException : public std::runtime_error
+{
+private:
+    std::string _message;
+
+public:
+    SystemException():
+        std::runtime_error("equi_join bench")
+    {}
+
+    template <typename T>
+    SystemException& operator<<(T const& item)
+    {
+        std::ostringstream out;
+        out << item;
+        _message += out.str();
+        return *this;
+    }
+
+    char const* what() const noexcept override
+    {
+        return _message.c_str();
+    }
+};
+
+enum
+{
+    SCIDB_SE_INTERNAL,
+    SCIDB_SE_OPERATOR,
+    SCIDB_LE_ILLEGAL_OPERATION
+};
+
+#define SYSTEM_EXCEPTION(a, b) ::scidb::SystemException()
+#define USER_EXCEPTION(a, b)   ::scidb::SystemException()
+
+inline void notInBench(char const* what)
+{
+    throw SystemException() << what << " is not available in the benchmark shim";
+}
+
+template <typename T, typename F>
+T safe_static_cast(F f)
+{
+    return static_cast<T>(f);
+}
+
+template <typename T, typename F>
+T safe_dynamic_cast(F f)
+{
+    T t = dynamic_cast<T>(f);
+    if(f != NULL && t == NULL)
+    {
+        throw SystemException() << "safe_dynamic_cast failed";
+    }
+    return t;
+}
+
+/**
+ * A datum, stored like SciDB's: up to 8 bytes inline, larger ones on the heap. A null has a missing reason >= 0.
+ */
+class Value
+{
+public:
+    typedef int32_t reason;
+
+private:
+    size_t  _size;
+    reason  _missingReason;
+    union
+    {
+        int64_t _inline;
+        char*   _large;
+    };
+
+    bool large() const
+    {
+        return _size > sizeof(_inline);
+    }
+
+    void release()
+    {
+        if(large())
+        {
+            delete[] _large;
+        }
+        _size = 0;
+    }
+
+public:
+    Value():
+        _size(0),
+        _missingReason(-1),
+        _inline(0)
+    {}
+
+    Value(Value const& other):
+        _size(0),
+        _missingReason(other._missingReason),
+        _inline(0)
+    {
+        setData(other.data(), other._size);
+        _missingReason = other._missingReason;
+    }
+
+    Value(Value&& other) noexcept:
+        _size(other._size),
+        _missingReason(other._missingReason),
+        _inline(other._inline)
+    {
+        other._size = 0;
+    }
+
+    Value& operator=(Value const& other)
+    {
+        if(this != &other)
+        {
+            setData(other.data(), other._size);
+            _missingReason = other._missingReason;
+        }
+        return *this;
+    }
+
+    Value& operator=(Value&& other) noexcept
+    {
+        if(this != &other)
+        {
+            release();
+            _size = other._size;
+            _missingReason = other._missingReason;
+            _inline = other._inline;
+            other._size = 0;
+        }
+        return *this;
+    }
+
+    ~Value()
+    {
+        release();
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    void const* data() const
+    {
+        return large() ? static_cast<void const*>(_large) : static_cast<void const*>(&_inline);
+    }
+
+    void* data()
+    {
+        return large() ? static_cast<void*>(_large) : static_cast<void*>(&_inline);
+    }
+
+    bool isLarge() const
+    {
+        return large();
+    }
+
+    bool isNull() const
+    {
+        return _missingReason >= 0;
+    }
+
+    reason getMissingReason() const
+    {
+        return _missingReason;
+    }
+
+    void setNull(reason const missingReason = 0)
+    {
+        release();
+        _missingReason = missingReason;
+    }
+
+    void setSize(size_t const size)
+    {
+        if(size != _size)
+        {
+            release();
+            _size = size;
+            if(large())
+            {
+                _large = new char[size];
+            }
+        }
+        _missingReason = -1;
+    }
+
+    void setData(void const* data, size_t const size)
+    {
+        setSize(size);
+        if(size)
+        {
+            memcpy(this->data(), data, size);
+        }
+    }
+
+#define EJ_BENCH_ACCESSORS(NAME, T) \
+    T get##NAME() const { T t; memcpy(&t, data(), sizeof(T)); return t; } \
+    void set##NAME(T t) { setData(&t, sizeof(T)); }
+    EJ_BENCH_ACCESSORS(Bool,   bool)
+    EJ_BENCH_ACCESSORS(Uint8,  uint8_t)
+    EJ_BENCH_ACCESSORS(Int32,  int32_t)
+    EJ_BENCH_ACCESSORS(Uint32, uint32_t)
+    EJ_BENCH_ACCESSORS(Int64,  int64_t)
+    EJ_BENCH_ACCESSORS(Uint64, uint64_t)
+    EJ_BENCH_ACCESSORS(Double, double)
+#undef EJ_BENCH_ACCESSORS
+
+    char const* getString() const
+    {
+        return static_cast<char const*>(data());
+    }
+
+    void setString(std::string const& str)
+    {
+        setData(str.c_str(), str.size() + 1);
+    }
+
+    bool operator==(Value const& other) const
+    {
+        return _missingReason == other._missingReason && _size == other._size && memcmp(data(), other.data(), _size) == 0;
+    }
+
+    bool operator!=(Value const& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+inline size_t typeSize(TypeId const& type)
+{
+    if(type == TID_BOOL)
+    {
+        return 1;
+    }
+    if(type == TID_INT32 || type == TID_UINT32)
+    {
+        return 4;
+    }
+    if(type == TID_STRING)
+    {
+        return 0;
+    }
+    return 8;
+}
+
+/**
+ * Less-than over values of one type, as used for sorting keys within a hash bucket.
+ */
+class AttributeComparator
+{
+private:
+    TypeId _type;
+
+public:
+    AttributeComparator(TypeId const& type = TID_INT64):
+        _type(type)
+    {}
+
+    bool operator()(Value const& a, Value const& b) const
+    {
+        if(_type == TID_INT64)
+        {
+            return a.getInt64() < b.getInt64();
+        }
+        if(_type == TID_DOUBLE)
+        {
+            return a.getDouble() < b.getDouble();
+        }
+        if(_type == TID_STRING)
+        {
+            return strcmp(a.getString(), b.getString()) < 0;
+        }
+        if(_type == TID_UINT32)
+        {
+            return a.getUint32() < b.getUint32();
+        }
+        if(_type == TID_INT32)
+        {
+            return a.getInt32() < b.getInt32();
+        }
+        if(_type == TID_UINT64)
+        {
+            return a.getUint64() < b.getUint64();
+        }
+        return a.getBool() < b.getBool();
+    }
+};
+
+enum class CompressorType
+{
+    NONE    = 0,
+    ZLIB    = 1,
+    BZLIB   = 2,
+    UNKNOWN = 99
+};
+
+class AttributeDesc
+{
+private:
+    std::string _name;
+    TypeId      _type;
+    int16_t     _flags;
+    AttributeID _id;
+
+public:
+    enum
+    {
+        IS_NULLABLE        = 1,
+        IS_EMPTY_INDICATOR = 2
+    };
+
+    AttributeDesc():
+        _flags(0),
+        _id(0)
+    {}
+
+    AttributeDesc(std::string const& name, TypeId const& type, int16_t flags, CompressorType,
+                  std::set<std::string> const& = std::set<std::string>()):
+        _name(name),
+        _type(type),
+        _flags(flags),
+        _id(0)
+    {}
+
+    std::string const& getName() const
+    {
+        return _name;
+    }
+
+    TypeId const& getType() const
+    {
+        return _type;
+    }
+
+    int16_t getFlags() const
+    {
+        return _flags;
+    }
+
+    size_t getSize() const
+    {
+        return typeSize(_type);
+    }
+
+    bool isNullable() const
+    {
+        return _flags & IS_NULLABLE;
+    }
+
+    AttributeID getId() const
+    {
+        return _id;
+    }
+
+    void setId(AttributeID const id)
+    {
+        _id = id;
+    }
+
+    std::set<std::string> getAliases() const
+    {
+        return std::set<std::string>();
+    }
+};
+
+class Attributes
+{
+private:
+    std::vector<AttributeDesc> _attributes;
+
+public:
+    typedef std::vector<AttributeDesc>::const_iterator const_iterator;
+
+    size_t size() const
+    {
+        return _attributes.size();
+    }
+
+    AttributeDesc const& findattr(size_t const i) const
+    {
+        return _attributes[i];
+    }
+
+    void push_back(AttributeDesc const& attribute)
+    {
+        _attributes.push_back(attribute);
+        _attributes.back().setId(safe_static_cast<AttributeID>(_attributes.size() - 1));
+    }
+
+    void addEmptyTagAttribute()
+    {
+        push_back(AttributeDesc("EmptyTag", TID_BOOL, AttributeDesc::IS_EMPTY_INDICATOR, CompressorType::NONE));
+    }
+
+    const_iterator begin() const
+    {
+        return _attributes.begin();
+    }
+
+    const_iterator end() const
+    {
+        return _attributes.end();
+    }
+
+    AttributeDesc const& firstDataAttribute() const
+    {
+        return _attributes[0];
+    }
+};
+
+struct CoordinateBounds
+{
+    static Coordinate getMax()
+    {
+        return (1LL << 62) - 1;
+    }
+
+    static Coordinate getMin()
+    {
+        return -getMax();
+    }
+};
+
+class DimensionDesc
+{
+private:
+    std::string _name;
+    Coordinate  _start;
+    Coordinate  _end;
+    int64_t     _chunkInterval;
+    int64_t     _chunkOverlap;
+
+public:
+    DimensionDesc(std::string const& name, Coordinate start, Coordinate end, int64_t chunkInterval, int64_t chunkOverlap):
+        _name(name),
+        _start(start),
+        _end(end),
+        _chunkInterval(chunkInterval),
+        _chunkOverlap(chunkOverlap)
+    {}
+
+    std::string const& getBaseName() const
+    {
+        return _name;
+    }
+
+    Coordinate getStartMin() const
+    {
+        return _start;
+    }
+
+    Coordinate getEndMax() const
+    {
+        return _end;
+    }
+
+    Coordinate getCurrStart() const
+    {
+        return _start;
+    }
+
+    Coordinate getCurrEnd() const
+    {
+        return _end;
+    }
+
+    int64_t getChunkInterval() const
+    {
+        return _chunkInterval;
+    }
+
+    int64_t getChunkOverlap() const
+    {
+        return _chunkOverlap;
+    }
+};
+typedef std::vector<DimensionDesc> Dimensions;
+
+enum DistType
+{
+    dtUninitialized,
+    dtUndefined,
+    dtHashPartitioned,
+    dtLocalInstance,
+    dtByRow,
+    dtByCol,
+    dtReplication,
+    dtRowCyclic,
+    dtColCyclic
+};
+
+inline bool isReplicated(DistType const type)
+{
+    return type == dtReplication;
+}
+
+class ArrayDistribution
+{
+private:
+    DistType _type;
+
+public:
+    ArrayDistribution(DistType const type):
+        _type(type)
+    {}
+
+    DistType getDistType() const
+    {
+        return _type;
+    }
+
+    size_t getRedundancy() const
+    {
+        return 0;
+    }
+
+    bool checkCompatibility(std::shared_ptr<const ArrayDistribution> const& other) const
+    {
+        return _type == other->_type;
+    }
+};
+typedef std::shared_ptr<const ArrayDistribution> ArrayDistPtr;
+
+inline ArrayDistPtr createDistribution(DistType const type)
+{
+    return std::make_shared<ArrayDistribution>(type);
+}
+
+inline std::ostream& operator<<(std::ostream& out, ArrayDistribution const& dist)
+{
+    return out << dist.getDistType();
+}
+
+class ArrayResidency
+{
+public:
+    size_t size() const
+    {
+        return 1;
+    }
+
+    bool isEqual(std::shared_ptr<const ArrayResidency> const&) const
+    {
+        return true;
+    }
+};
+typedef std::shared_ptr<const ArrayResidency> ArrayResPtr;
+
+class ArrayDesc
+{
+private:
+    std::string  _name;
+    Attributes   _attributes;
+    Attributes   _dataAttributes;
+    Dimensions   _dimensions;
+    ArrayDistPtr _distribution;
+    ArrayResPtr  _residency;
+
+public:
+    ArrayDesc()
+    {}
+
+    ArrayDesc(std::string const& name, Attributes const& attributes, Dimensions const& dimensions, ArrayDistPtr const& distribution,
+              ArrayResPtr const& residency):
+        _name(name),
+        _attributes(attributes),
+        _dimensions(dimensions),
+        _distribution(distribution),
+        _residency(residency)
+    {
+        for(auto const& attribute : attributes)
+        {
+            if(!(attribute.getFlags() & AttributeDesc::IS_EMPTY_INDICATOR))
+            {
+                _dataAttributes.push_back(attribute);
+            }
+        }
+    }
+
+    std::string const& getName() const
+    {
+        return _name;
+    }
+
+    Attributes const& getAttributes(bool excludeEmptyBitmap = false) const
+    {
+        return excludeEmptyBitmap ? _dataAttributes : _attributes;
+    }
+
+    AttributeDesc const* getEmptyBitmapAttribute() const
+    {
+        return &_attributes.findattr(_attributes.size() - 1);
+    }
+
+    Dimensions const& getDimensions() const
+    {
+        return _dimensions;
+    }
+
+    ArrayDistPtr getDistribution() const
+    {
+        return _distribution;
+    }
+
+    ArrayResPtr getResidency() const
+    {
+        return _residency;
+    }
+};
+
+/**
+ * A query running on a single instance.
+ */
+class Query
+{
+public:
+    size_t getInstancesCount() const
+    {
+        return 1;
+    }
+
+    InstanceID getInstanceID() const
+    {
+        return 0;
+    }
+
+    bool isCoordinator() const
+    {
+        return true;
+    }
+
+    InstanceID getCoordinatorID() const
+    {
+        return 0;
+    }
+
+    ArrayResPtr getDefaultArrayResidency() const
+    {
+        return std::make_shared<ArrayResidency>();
+    }
+};
+
+class SharedBuffer
+{
+public:
+    virtual ~SharedBuffer()
+    {}
+    virtual void* getWriteData() = 0;
+    virtual void const* getConstData() const = 0;
+    virtual size_t getSize() const = 0;
+};
+
+class MemoryBuffer : public SharedBuffer
+{
+private:
+    std::vector<char> _data;
+
+public:
+    MemoryBuffer(char const*, void const* data, size_t const size):
+        _data(size)
+    {
+        if(data)
+        {
+            memcpy(_data.data(), data, size);
+        }
+    }
+
+    void* getWriteData() override
+    {
+        return _data.data();
+    }
+
+    void const* getConstData() const override
+    {
+        return _data.data();
+    }
+
+    size_t getSize() const override
+    {
+        return _data.size();
+    }
+};
+
+//with a single instance, nothing is ever sent
+inline void BufSend(InstanceID, std::shared_ptr<SharedBuffer> const&, std::shared_ptr<Query>&)
+{
+    notInBench("BufSend");
+}
+
+inline std::shared_ptr<SharedBuffer> BufReceive(InstanceID, std::shared_ptr<Query>&)
+{
+    notInBench("BufReceive");
+    return std::shared_ptr<SharedBuffer>();
+}
+
+enum
+{
+    CONFIG_MERGE_SORT_BUFFER,
+    CONFIG_STRING_SIZE_ESTIMATION,
+    CONFIG_MEM_ARRAY_THRESHOLD,
+    CONFIG_MAX_MEMORY_LIMIT,
+    CONFIG_SMGR_CACHE_SIZE
+};
+
+/**
+ * SciDB's defaults, with max-memory-limit unset. Options are held in a boost::any of the type of the option, as in
+ * SciDB - int for INTEGER options, size_t for SIZE ones - so reading one as the wrong type throws bad_any_cast here too.
+ */
+class Config
+{
+public:
+    static Config* getInstance()
+    {
+        static Config instance;
+        return &instance;
+    }
+
+    template <typename T>
+    T getOption(int const option) const
+    {
+        return boost::any_cast<T>(getValue(option));
+    }
+
+private:
+    boost::any getValue(int const option) const
+    {
+        switch(option)
+        {
+        case CONFIG_MERGE_SORT_BUFFER:      return int(128);
+        case CONFIG_STRING_SIZE_ESTIMATION: return int(256);
+        case CONFIG_MEM_ARRAY_THRESHOLD:    return size_t(1024);
+        case CONFIG_MAX_MEMORY_LIMIT:       return int(-1);
+        case CONFIG_SMGR_CACHE_SIZE:        return size_t(256);
+        }
+        return boost::any();
+    }
+};
+
+namespace arena
+{
+
+/**
+ * Allocates out of pages that are only freed with the arena, like a resetting SciDB arena.
+ */
+class Arena : public boost::noncopyable
+{
+private:
+    size_t             _pageSize;
+    std::vector<char*> _pages;
+    size_t             _pageUsed;
+    size_t             _allocated;
+
+public:
+    Arena(size_t const pageSize):
+        _pageSize(pageSize),
+        _pageUsed(pageSize),
+        _allocated(0)
+    {}
+
+    ~Arena()
+    {
+        for(size_t i=0; i<_pages.size(); ++i)
+        {
+            free(_pages[i]);
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        size = (size + 15) & ~size_t(15);
+        if(size > _pageSize)
+        {
+            _pages.push_back(static_cast<char*>(malloc(size)));
+            _allocated += size;
+            return _pages.back();
+        }
+        if(_pageUsed + size > _pageSize)
+        {
+            _pages.push_back(static_cast<char*>(malloc(_pageSize)));
+            _pageUsed = 0;
+        }
+        void* result = _pages.back() + _pageUsed;
+        _pageUsed  += size;
+        _allocated += size;
+        return result;
+    }
+
+    size_t allocated() const
+    {
+        return _allocated;
+    }
+};
+typedef std::shared_ptr<Arena> ArenaPtr;
+
+class Options
+{
+private:
+    size_t _pageSize;
+
+public:
+    Options(char const*):
+        _pageSize(64 * 1024)
+    {}
+
+    Options& resetting(bool)
+    {
+        return *this;
+    }
+
+    Options& threading(bool)
+    {
+        return *this;
+    }
+
+    Options& pagesize(size_t const pageSize)
+    {
+        _pageSize = pageSize;
+        return *this;
+    }
+
+    Options& parent(ArenaPtr const&)
+    {
+        return *this;
+    }
+
+    size_t getPageSize() const
+    {
+        return _pageSize;
+    }
+};
+
+inline ArenaPtr newArena(Options const& options)
+{
+    return std::make_shared<Arena>(options.getPageSize());
+}
+
+} //namespace arena
+
+namespace mgd
+{
+template <typename T>
+class vector : public std::vector<T>
+{
+public:
+    vector(arena::ArenaPtr const&, size_t const size, T const& value):
+        std::vector<T>(size, value)
+    {}
+
+    explicit vector(arena::ArenaPtr const&)
+    {}
+};
+} //namespace mgd
+
+/**
+ * Operator parameters. Expressions are constants, which is all the settings need for ids and numbers.
+ */
+class LogicalExpression
+{};
+
+inline Value evaluate(std::shared_ptr<LogicalExpression> const&, TypeId const&)
+{
+    notInBench("evaluate");
+    return Value();
+}
+
+inline std::shared_ptr<LogicalExpression> parseExpression(std::string const&)
+{
+    notInBench("parseExpression");
+    return std::shared_ptr<LogicalExpression>();
+}
+
+struct BindInfo
+{
+    enum
+    {
+        BI_ATTRIBUTE,
+        BI_COORDINATE,
+        BI_VALUE
+    };
+    int    kind;
+    size_t resolvedId;
+    Value  value;
+};
+
+class Expression;
+
+class ExpressionContext
+{
+private:
+    std::vector<Value> _values;
+
+public:
+    ExpressionContext(Expression&)
+    {}
+
+    Value& operator[](size_t const i)
+    {
+        if(_values.size() <= i)
+        {
+            _values.resize(i + 1);
+        }
+        return _values[i];
+    }
+};
+
+class Expression
+{
+private:
+    Value                 _constant;
+    std::vector<BindInfo> _bindings;
+
+public:
+    Expression()
+    {}
+
+    explicit Expression(Value const& constant):
+        _constant(constant)
+    {}
+
+    void compile(std::shared_ptr<LogicalExpression> const&, bool, TypeId const&, std::vector<ArrayDesc> const&, ArrayDesc const&)
+    {
+        notInBench("Expression::compile");
+    }
+
+    std::vector<BindInfo> const& getBindings() const
+    {
+        return _bindings;
+    }
+
+    Value const& evaluate(ExpressionContext&)
+    {
+        return _constant;
+    }
+
+    Value const& evaluate()
+    {
+        return _constant;
+    }
+};
+
+enum OperatorParamType
+{
+    PARAM_UNKNOWN,
+    PARAM_ARRAY_REF,
+    PARAM_ATTRIBUTE_REF,
+    PARAM_DIMENSION_REF,
+    PARAM_LOGICAL_EXPRESSION,
+    PARAM_PHYSICAL_EXPRESSION,
+    PARAM_SCHEMA,
+    PARAM_AGGREGATE_CALL,
+    PARAM_NESTED
+};
+
+class OperatorParam
+{
+private:
+    OperatorParamType _type;
+
+public:
+    OperatorParam(OperatorParamType const type = PARAM_UNKNOWN):
+        _type(type)
+    {}
+
+    virtual ~OperatorParam()
+    {}
+
+    OperatorParamType getParamType() const
+    {
+        return _type;
+    }
+};
+typedef std::shared_ptr<OperatorParam>         Parameter;
+typedef std::vector<Parameter>                 Parameters;
+typedef std::map<std::string, Parameter>       KeywordParameters;
+
+class OperatorParamLogicalExpression : public OperatorParam
+{
+private:
+    std::shared_ptr<LogicalExpression> _expression;
+
+public:
+    OperatorParamLogicalExpression():
+        OperatorParam(PARAM_LOGICAL_EXPRESSION)
+    {}
+
+    std::shared_ptr<LogicalExpression> const& getExpression() const
+    {
+        return _expression;
+    }
+};
+
+class OperatorParamPhysicalExpression : public OperatorParam
+{
+private:
+    std::shared_ptr<Expression> _expression;
+
+public:
+    OperatorParamPhysicalExpression(std::shared_ptr<Expression> const& expression):
+        OperatorParam(PARAM_PHYSICAL_EXPRESSION),
+        _expression(expression)
+    {}
+
+    std::shared_ptr<Expression> const& getExpression() const
+    {
+        return _expression;
+    }
+};
+
+class OperatorParamNested : public OperatorParam
+{
+private:
+    Parameters _parameters;
+
+public:
+    OperatorParamNested():
+        OperatorParam(PARAM_NESTED)
+    {}
+
+    Parameters& getParameters()
+    {
+        return _parameters;
+    }
+};
+
+class OperatorParamReference : public OperatorParam
+{
+private:
+    std::string _name;
+
+public:
+    OperatorParamReference(OperatorParamType const type, std::string const& name):
+        OperatorParam(type),
+        _name(name)
+    {}
+
+    std::string const& getObjectName() const
+    {
+        return _name;
+    }
+};
+
+class OperatorParamDimensionReference : public OperatorParamReference
+{
+public:
+    OperatorParamDimensionReference(std::string const& name):
+        OperatorParamReference(PARAM_DIMENSION_REF, name)
+    {}
+};
+
+class OperatorParamAttributeReference : public OperatorParamReference
+{
+public:
+    OperatorParamAttributeReference(std::string const& name):
+        OperatorParamReference(PARAM_ATTRIBUTE_REF, name)
+    {}
+};
+
+/**
+ * Arrays and chunks. Only the interfaces: no benchmark reads or writes an array.
+ */
+class ConstChunkIterator
+{
+public:
+    enum
+    {
+        IGNORE_OVERLAPS    = 1,
+        IGNORE_EMPTY_CELLS = 2,
+        SEQUENTIAL_WRITE   = 4,
+        NO_EMPTY_CHECK     = 8,
+        APPEND_CHUNK       = 16
+    };
+    virtual ~ConstChunkIterator()
+    {}
+    virtual bool end() = 0;
+    virtual void operator++() = 0;
+    virtual Value const& getItem() = 0;
+    virtual Coordinates const& getPosition() = 0;
+    virtual bool setPosition(Coordinates const&) = 0;
+    virtual void restart() = 0;
+};
+
+class ChunkIterator : public ConstChunkIterator
+{
+public:
+    virtual void writeItem(Value const&) = 0;
+    virtual void flush() = 0;
+};
+
+class Array;
+
+class ConstChunk
+{
+public:
+    virtual ~ConstChunk()
+    {}
+    virtual size_t count() const = 0;
+    virtual std::shared_ptr<ConstChunkIterator> getConstIterator(int mode = 0) const = 0;
+    virtual Coordinates const& getFirstPosition(bool withOverlap) const = 0;
+    virtual Coordinates const& getLastPosition(bool withOverlap) const = 0;
+    virtual size_t getSize() const = 0;
+    virtual bool isMaterialized() const
+    {
+        return true;
+    }
+};
+
+class Chunk : public ConstChunk
+{
+public:
+    virtual std::shared_ptr<ChunkIterator> getIterator(std::shared_ptr<Query> const&, int mode) = 0;
+};
+
+struct Address
+{
+    AttributeID attId;
+    Coordinates coords;
+
+    Address():
+        attId(0)
+    {}
+
+    Address(AttributeID const attId, Coordinates const& coords):
+        attId(attId),
+        coords(coords)
+    {}
+};
+
+class MemChunk : public Chunk
+{
+public:
+    void initialize(Array const*, ArrayDesc const*, Address const&, CompressorType)
+    {
+        notInBench("MemChunk");
+    }
+
+    size_t count() const override
+    {
+        return 0;
+    }
+
+    std::shared_ptr<ConstChunkIterator> getConstIterator(int = 0) const override
+    {
+        notInBench("MemChunk");
+        return std::shared_ptr<ConstChunkIterator>();
+    }
+
+    std::shared_ptr<ChunkIterator> getIterator(std::shared_ptr<Query> const&, int) override
+    {
+        notInBench("MemChunk");
+        return std::shared_ptr<ChunkIterator>();
+    }
+
+    Coordinates const& getFirstPosition(bool) const override
+    {
+        notInBench("MemChunk");
+        static Coordinates none;
+        return none;
+    }
+
+    Coordinates const& getLastPosition(bool) const override
+    {
+        notInBench("MemChunk");
+        static Coordinates none;
+        return none;
+    }
+
+    size_t getSize() const override
+    {
+        return 0;
+    }
+};
+
+class ConstIterator
+{
+public:
+    virtual ~ConstIterator()
+    {}
+    virtual bool end() = 0;
+    virtual void operator++() = 0;
+    virtual Coordinates const& getPosition() = 0;
+    virtual bool setPosition(Coordinates const&) = 0;
+    virtual void restart() = 0;
+};
+
+class ConstArrayIterator : public ConstIterator
+{
+public:
+    virtual ConstChunk const& getChunk() = 0;
+};
+
+class ArrayIterator : public ConstArrayIterator
+{
+public:
+    virtual Chunk& newChunk(Coordinates const&) = 0;
+};
+
+class Array : public std::enable_shared_from_this<Array>
+{
+public:
+    enum Access
+    {
+        SINGLE_PASS = 0,
+        MULTI_PASS,
+        RANDOM
+    };
+    virtual ~Array()
+    {}
+    virtual ArrayDesc const& getArrayDesc() const = 0;
+    virtual std::shared_ptr<ConstArrayIterator> getConstIterator(AttributeDesc const&) const = 0;
+    virtual std::shared_ptr<ArrayIterator> getIterator(AttributeDesc const&)
+    {
+        notInBench("Array::getIterator");
+        return std::shared_ptr<ArrayIterator>();
+    }
+    virtual bool isMaterialized() const
+    {
+        return false;
+    }
+    virtual Access getSupportedAccess() const
+    {
+        return RANDOM;
+    }
+};
+typedef std::shared_ptr<Array> ArrayPtr;
+
+class MemArray : public Array
+{
+private:
+    ArrayDesc _desc;
+
+public:
+    MemArray(ArrayDesc const& desc, std::shared_ptr<Query> const&):
+        _desc(desc)
+    {}
+
+    ArrayDesc const& getArrayDesc() const override
+    {
+        return _desc;
+    }
+
+    std::shared_ptr<ConstArrayIterator> getConstIterator(AttributeDesc const&) const override
+    {
+        notInBench("MemArray");
+        return std::shared_ptr<ConstArrayIterator>();
+    }
+
+    bool isMaterialized() const override
+    {
+        return true;
+    }
+};
+
+class StreamArray : public Array
+{
+protected:
+    ArrayDesc _desc;
+
+public:
+    StreamArray(ArrayDesc const& desc, bool = true):
+        _desc(desc)
+    {}
+
+    ArrayDesc const& getArrayDesc() const override
+    {
+        return _desc;
+    }
+
+    std::shared_ptr<ConstArrayIterator> getConstIterator(AttributeDesc const&) const override
+    {
+        notInBench("StreamArray");
+        return std::shared_ptr<ConstArrayIterator>();
+    }
+
+    Access getSupportedAccess() const override
+    {
+        return SINGLE_PASS;
+    }
+};
+
+class SinglePassArray : public StreamArray
+{
+public:
+    SinglePassArray(ArrayDesc const& desc):
+        StreamArray(desc, false)
+    {}
+
+    void setEnforceHorizontalIteration(bool)
+    {}
+
+protected:
+    virtual size_t getCurrentRowIndex() const = 0;
+    virtual bool moveNext(size_t rowIndex) = 0;
+    virtual ConstChunk const& getChunk(AttributeID attr, size_t rowIndex) = 0;
+};
+
+struct SortingAttributeInfo
+{
+    int  columnNo;
+    bool ascent;
+};
+typedef std::vector<SortingAttributeInfo> SortingAttributeInfos;
+
+class TupleComparator
+{
+public:
+    TupleComparator(SortingAttributeInfos const&, ArrayDesc const&)
+    {}
+};
+
+class SortArray
+{
+public:
+    SortArray(ArrayDesc const&, arena::ArenaPtr const&, bool = false, size_t = 0)
+    {
+        notInBench("SortArray");
+    }
+};
+
+} //namespace scidb
+
+#endif //EQUI_JOIN_BENCH_SCIDB_SHIM_H
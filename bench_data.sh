@@ -0,0 +1,114 @@
+#!/bin/bash
+# Synthetic inputs for bench.sh, stored into the SciDB that iquery connects to.
+# Source this file to use the functions below, or run it to store one keyed array:
+#  ./bench_data.sh <name> <cells> <distinct_keys> <skew> <key_type> [<first_key>]
+
+# The expression of a key rank in [0, distinct): uniform for a skew of 0, otherwise a power of a uniform draw that piles
+# the ranks up towards 0, more so as the skew grows; with a skew of 3, about 20% of the cells have the first 1% of the keys
+rank_expression () {
+    local distinct=$1
+    local skew=$2
+    if [ "$skew" = "0" ]; then
+        echo "int64(random() % $distinct)"
+    else
+        echo "int64(floor($distinct * pow(double(random()) / 2147483648.0, $skew)))"
+    fi
+}
+
+# The key attributes of a key type, from the rank r, as apply() arguments
+key_expressions () {
+    case "$1" in
+        int64)        echo "k, r" ;;
+        double)       echo "k, double(r) + 0.5" ;;
+        string)       echo "k, 'k' + string(r)" ;;  # held in place in a Value up to 8 bytes
+        long_string)  echo "k, 'key-000000000000000000000000000000000000' + string(r)" ;;
+        int64_string) echo "k, r / 64, k2, 'k' + string(r % 64)" ;;
+        *)            echo "unknown key type $1" >&2; return 1 ;;
+    esac
+}
+
+# The key attributes of a key type, for project()
+key_names () {
+    if [ "$1" = "int64_string" ]; then
+        echo "k, k2"
+    else
+        echo "k"
+    fi
+}
+
+# The left_ids or right_ids of a key type
+key_ids () {
+    if [ "$1" = "int64_string" ]; then
+        echo "(0,1)"
+    else
+        echo "0"
+    fi
+}
+
+chunk_length () {
+    if [ "$1" -lt 1000000 ]; then
+        echo "$1"
+    else
+        echo 1000000
+    fi
+}
+
+# <name> <cells> <distinct_keys> <skew> <key_type> [<first_key>]
+# Stores <k[, k2], v:int64>[i] with the keys of ranks first_key to first_key + distinct_keys - 1. Arrays for the same
+# key type and distinct keys starting at different first keys overlap by (distinct_keys - first_key) / distinct_keys.
+make_keyed_array () {
+    local name=$1
+    local cells=$2
+    local distinct=$3
+    local skew=$4
+    local key_type=$5
+    local first=${6:-0}
+    local keys
+    keys=`key_expressions $key_type` || return 1
+    iquery -anq "remove($name)" > /dev/null 2>&1
+    iquery -anq "store(
+                  project(
+                   apply(
+                    apply(build(<v:int64>[i=0:$((cells - 1)),`chunk_length $cells`,0], i), r, `rank_expression $distinct $skew` + $first),
+                    $keys),
+                   `key_names $key_type`, v),
+                  $name)"
+}
+
+# <name> <distinct_keys>
+# Stores <v:int64>[k] with one cell per key, for joining int64 keys on a dimension
+make_dimension_array () {
+    local name=$1
+    local distinct=$2
+    iquery -anq "remove($name)" > /dev/null 2>&1
+    iquery -anq "store(build(<v:int64>[k=0:$((distinct - 1)),`chunk_length $distinct`,0], k), $name)"
+}
+
+# <name> <prefix> <cells> <max_length> <chromosome_length>
+# Stores <chromosome_id:int64, <prefix>_start:int64, <prefix>_end:int64, v:int64>[i] with intervals of 1 to max_length
+# positions on 24 chromosomes
+make_interval_array () {
+    local name=$1
+    local prefix=$2
+    local cells=$3
+    local max_length=$4
+    local chromosome_length=$5
+    iquery -anq "remove($name)" > /dev/null 2>&1
+    iquery -anq "store(
+                  project(
+                   apply(
+                    apply(build(<v:int64>[i=0:$((cells - 1)),`chunk_length $cells`,0], i),
+                          chromosome_id, int64(random() % 24), ${prefix}_start, int64(random() % $chromosome_length)),
+                    ${prefix}_end, ${prefix}_start + int64(random() % $max_length)),
+                   chromosome_id, ${prefix}_start, ${prefix}_end, v),
+                  $name)"
+}
+
+if [ "${BASH_SOURCE[0]}" = "$0" ]; then
+    if [ $# -lt 5 ]; then
+        echo "usage: $0 <name> <cells> <distinct_keys> <skew> <key_type> [<first_key>]" >&2
+        echo "  key_type: int64, double, string, long_string or int64_string" >&2
+        exit 1
+    fi
+    make_keyed_array "$@"
+fi
@@ -29,6 +29,12 @@ log_unsorted_query () {
     ( iquery "$FMT" -aq "$1" | print_header_then sort ) >> $OUTFILE 2>&1
 }
 
+# Use this to log a query that is expected to fail with the given message. Only the message is logged, as the rest
+# of the error names source files and lines.
+log_failing_query () {
+    iquery "$FMT" -aq "$1" 2>&1 | grep -o "$2" >> $OUTFILE
+}
+
 # Helper function for log_unsorted_query.
 # Given an input stream, prints the first line of the stream,
 # then applies the given command (e.g. sort, grep) to the remainder of the stream.
@@ -43,6 +49,24 @@ iquery -anq "remove(right)" > /dev/null 2>&1
 iquery -anq "store(apply(build(<a:string>[i=0:5,2,0], '[(null),(def),(ghi),(jkl),(mno)]', true), b, double(i)*1.1), left)" > /dev/null 2>&1
 iquery -anq "store(apply(build(<c:string>[j=1:5,3,0], '[(def),(mno),(null),(def)]', true), d, j), right)" > /dev/null 2>&1
 
+# Same chunk grid: chunks 0 and 3 are in both, 1 only in aligned_left, 2 only in aligned_right
+iquery -anq "remove(aligned_left)"  > /dev/null 2>&1
+iquery -anq "remove(aligned_right)" > /dev/null 2>&1
+iquery -anq "store(filter(build(<x:int64>[i=0:11,3,0], i*10),  i<5 or i>8), aligned_left)" > /dev/null 2>&1
+iquery -anq "store(filter(build(<y:int64>[i=0:11,3,0], i*100), (i>0 and i<3) or (i>5 and i<8) or i>9), aligned_right)" > /dev/null 2>&1
+
+# Same dimensions and chunking, stored with the same distribution: co-located on any number of instances
+iquery -anq "remove(colocated_left)"  > /dev/null 2>&1
+iquery -anq "remove(colocated_right)" > /dev/null 2>&1
+iquery -anq "store(apply(build(<x:int64>[i=0:11,3,0], i*10), k, i%3), colocated_left)" > /dev/null 2>&1
+iquery -anq "store(apply(filter(build(<y:int64>[i=0:11,3,0], i*100), i<9), k, i%2), colocated_right)" > /dev/null 2>&1
+
+# Key 0 is in 8 of the 12 left cells and 2 of the 6 right cells, enough to count as heavy with two or more instances
+iquery -anq "remove(skew_left)"  > /dev/null 2>&1
+iquery -anq "remove(skew_right)" > /dev/null 2>&1
+iquery -anq "store(apply(build(<x:int64>[i=0:11,4,0], i*10), k, iif(i<8, 0, i)), skew_left)" > /dev/null 2>&1
+iquery -anq "store(apply(build(<y:int64>[j=0:5,3,0], j), k, iif(j<2, 0, j*2+4)), skew_right)" > /dev/null 2>&1
+
 rm $OUTFILE > /dev/null 2>&1
 
 echo >> $OUTFILE 2>&1
@@ -439,4 +463,93 @@ log_query "sort(equi_join(left, right, left_names:i, right_names:j, left_outer:1
 log_query "sort(equi_join(left, right, left_names:i, right_names:j, left_outer:1, right_outer:1, algorithm:'merge_left_first'),  i)"
 log_query "sort(equi_join(left, right, left_names:i, right_names:j, left_outer:1, right_outer:1, algorithm:'merge_right_first'), i)"
 
+echo >> $OUTFILE 2>&1
+echo "Chapter 31" >> $OUTFILE 2>&1
+log_query "sort(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'merge_left_first',     shuffle_compression:'zlib'                         ), a,b,d)"
+log_query "sort(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'merge_right_first',    shuffle_compression:'bzlib', hash_join_threshold:0 ), a,b,d)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 32" >> $OUTFILE 2>&1
+log_query "sort(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'late_left_first'                                                    ), a,b,d)"
+log_query "sort(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'late_right_first'                                                   ), a,b,d)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 33" >> $OUTFILE 2>&1
+log_query "sort(equi_join(left, right, left_ids:0, right_ids:0, left_outer:true,  algorithm:'hash_replicate_left'), a,b,d)"
+log_query "sort(equi_join(left, right, left_ids:0, right_ids:0, right_outer:true, algorithm:'hash_replicate_right'),a,b,d)"
+log_query "sort(equi_join(left, right, left_names:i, right_names:j, left_outer:1, right_outer:1, algorithm:'hash_replicate_left'),  i)"
+log_query "sort(equi_join(left, right, left_names:i, right_names:j, left_outer:1, right_outer:1, algorithm:'hash_replicate_right'), i)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 34" >> $OUTFILE 2>&1
+log_query "project(filter(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'hash_replicate_left', explain:true), key='algorithm' and instance_id=0), value)"
+log_query "project(filter(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'merge_right_first',   explain:true), key='algorithm' and instance_id=0), value)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 35" >> $OUTFILE 2>&1
+log_query "project(filter(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'hash_replicate_left', profile:true), phase='write' and instance_id=0), phase)"
+log_query "project(filter(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'merge_right_first', hash_join_threshold:0, profile:true), phase='sort' and instance_id=0), phase)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 36" >> $OUTFILE 2>&1
+log_query "project(filter(equi_join(left, right, left_ids:0, right_ids:0, algorithm:'hash_replicate_left', profile:true), phase='hash_table' and instance_id=0), phase, runs, rows)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 37" >> $OUTFILE 2>&1
+log_query "sort(equi_join(aligned_left, aligned_right, left_names:i, right_names:i, hash_join_threshold:0                                     ), i)"
+log_query "sort(equi_join(aligned_left, aligned_right, left_names:i, right_names:i, hash_join_threshold:0, left_outer:true                    ), i)"
+log_query "sort(equi_join(aligned_left, aligned_right, left_names:i, right_names:i, hash_join_threshold:0, right_outer:true                   ), i)"
+log_query "sort(equi_join(aligned_left, aligned_right, left_names:i, right_names:i, hash_join_threshold:0, left_outer:true, right_outer:true  ), i)"
+log_query "sort(equi_join(aligned_left, filter(aligned_right, i>5 and i<9), left_names:i, right_names:i, hash_join_threshold:0                                     ), i)"
+log_query "sort(equi_join(aligned_left, filter(aligned_right, i>5 and i<9), left_names:i, right_names:i, hash_join_threshold:0, left_outer:true, right_outer:true  ), i)"
+log_query "project(filter(equi_join(aligned_left, aligned_right, left_names:i, right_names:i, hash_join_threshold:0, explain:true), key='algorithm' and instance_id=0), value)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 38" >> $OUTFILE 2>&1
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k)), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), left_outer:true), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), right_outer:true), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), left_outer:true, right_outer:true), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), hash_join_threshold:0), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), hash_join_threshold:0, left_outer:true), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), hash_join_threshold:0, right_outer:true), i, k)"
+log_query "sort(equi_join(colocated_left, colocated_right, left_names:(i,k), right_names:(i,k), hash_join_threshold:0, left_outer:true, right_outer:true), i, k)"
+log_query "sort(equi_join(colocated_right, colocated_left, left_names:(i,k), right_names:(i,k), left_outer:true, right_outer:true), i, k)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 39" >> $OUTFILE 2>&1
+log_query "sort(equi_join(left, right, left_names:i,     right_names:j,     algorithm:'lookup_left' ), i)"
+log_query "sort(equi_join(left, right, left_names:i,     right_names:j,     algorithm:'lookup_right'), i)"
+log_query "sort(equi_join(left, right, left_names:(i,a), right_names:(j,c), algorithm:'lookup_left' ), i)"
+log_query "sort(equi_join(left, right, left_names:(i,a), right_names:(j,c), algorithm:'lookup_right'), i)"
+log_failing_query "equi_join(left, right, left_ids:0, right_ids:0, algorithm:'lookup_left')"  "lookup_left requires all right dimensions to be join keys"
+log_failing_query "equi_join(left, right, left_ids:0, right_ids:0, algorithm:'lookup_right')" "lookup_right requires all left dimensions to be join keys"
+log_failing_query "equi_join(left, right, left_names:i, right_names:j, left_outer:true,  algorithm:'lookup_left')"  "lookup algorithms cannot be used for outer joins"
+log_failing_query "equi_join(left, right, left_names:i, right_names:j, right_outer:true, algorithm:'lookup_right')" "lookup algorithms cannot be used for outer joins"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 40" >> $OUTFILE 2>&1
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first'), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', left_outer:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', left_outer:true, skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', right_outer:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', right_outer:true, skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', left_outer:true, right_outer:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', left_outer:true, right_outer:true, skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_left_first', skew_handling:true, hash_join_threshold:0), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first'), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', left_outer:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', left_outer:true, skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', right_outer:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', right_outer:true, skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', left_outer:true, right_outer:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', left_outer:true, right_outer:true, skew_handling:true), k, x, y)"
+log_query "sort(equi_join(skew_left, skew_right, left_names:k, right_names:k, algorithm:'merge_right_first', skew_handling:true, hash_join_threshold:0), k, x, y)"
+
+echo >> $OUTFILE 2>&1
+echo "Chapter 41" >> $OUTFILE 2>&1
+log_query "project(apply(filter(equi_join(left, right, left_ids:0, right_ids:0, explain:true), key='memory_budget_bytes' and instance_id=0), at_least_64mb, int64(value) >= 67108864), at_least_64mb)"
+
 diff $OUTFILE test.expected && echo "$(basename $0) succeeded"